@@ -23,6 +23,8 @@ commands = [
   'perf.rb --params "dbm=baby,key_comparator=decimal" --iter 20000 --threads 5 --random',
   'perf.rb --params "dbm=stdhash,num_buckets=100000" --iter 20000 --threads 5 --random',
   'perf.rb --params "dbm=stdtree" --iter 20000 --threads 5 --random',
+  'perf.rb --path casket.tkh --params "num_buckets=100000" --iter 5000 --threads 5 --zipf' +
+  ' --workloads set,mixed,multi,process,iterate,async,remove --value_size 8,1000 --both_modes',
   'wicked.rb --path casket.tkh --params "num_buckets=100000" --iter 20000 --threads 5',
   'wicked.rb --path casket.tkt --params "key_comparator=decimal" --iter 20000 --threads 5',
   'wicked.rb --path casket.tks --params "step_unit=3" --iter 20000 --threads 5',
@@ -41,6 +41,10 @@ printf("  \$CFLAGS = %s\n", $CFLAGS)
 printf("  \$LDFLAGS = %s\n", $LDFLAGS)
 printf("  \$libs = %s\n", $libs)
 
+have_header('sys/sdt.h')
+have_func('rb_enc_interned_str', 'ruby/encoding.h')
+have_func('rb_io_buffer_get_bytes_for_writing', 'ruby/io/buffer.h')
+
 if have_header('tkrzw_lib_common.h')
   create_makefile('tkrzw')
 end
@@ -1,164 +1,306 @@
 #! /usr/bin/ruby -I. -w
 # -*- coding: utf-8 -*-
 
+require 'json'
 require 'optparse'
 require 'tkrzw'
 
 include Tkrzw
 
 
-# main routine
-def main
-  path = ""
-  open_params = {}
-  open_params_expr = ""
-  num_iterations = 10000
-  num_threads = 1
-  is_random = false
-  op = OptionParser.new
-  op.on('--path str') { |v| path = v }
-  op.on('--params str') { |v| open_params_expr = v }
-  op.on('--iter num') { |v| num_iterations = v.to_i }
-  op.on('--threads num') { |v| num_threads = v.to_i }
-  op.on('--random') { is_random = true }
-  op.parse(ARGV)
-  open_params_expr.split(",").each do |expr|
-    columns = expr.split("=", 2)
-    if columns.size == 2
-      open_params[columns[0]] = columns[1]
+# Generator of key numbers.
+class KeyGenerator
+  def initialize(num_keys, dist, theta, seed)
+    @num_keys = num_keys
+    @dist = dist
+    @rnd_state = Random.new(seed)
+    if @dist == "zipf"
+      @cdf = KeyGenerator.zipf_cdf(num_keys, theta)
     end
   end
-  printf("path: %s\n", path)
-  printf("params: %s\n", open_params)
-  printf("num_iterations: %d\n", num_iterations)
-  printf("num_threads: %d\n", num_threads)
-  printf("is_random: %s\n", is_random)
-  printf("\n")
-  open_params["truncate"] = true
+
+  # Makes the cumulative distribution of the Zipf distribution, which is shared by threads.
+  def self.zipf_cdf(num_keys, theta)
+    @zipf_cdfs ||= {}
+    @zipf_cdfs[[num_keys, theta]] ||= begin
+      weights = (1..num_keys).map { |rank| 1.0 / (rank ** theta) }
+      total = weights.sum
+      sum = 0.0
+      weights.map { |weight| sum += weight / total }
+    end
+  end
+
+  def next(seq)
+    case @dist
+    when "zipf"
+      prob_threshold = @rnd_state.rand
+      rank = @cdf.bsearch_index { |prob| prob >= prob_threshold } || @num_keys - 1
+      # Scatters popular keys over the key space.
+      (rank * 2654435761) % @num_keys
+    when "random"
+      @rnd_state.rand(@num_keys)
+    else
+      seq % @num_keys
+    end
+  end
+
+  def rand(num)
+    @rnd_state.rand(num)
+  end
+end
+
+
+# Runs a phase of the benchmark with threads and reports the result.
+def run_phase(label, dbm, conf, results)
+  print("#{label}:\n")
+  num_iterations = conf[:num_iterations]
+  num_threads = conf[:num_threads]
   GC.start
+  start_gc_stat = GC.stat
   start_mem_usage = Utility.get_memory_usage
-  dbm = DBM.new
-  dbm.open(path, true, open_params).or_die
-  print("Setting:\n")
-  start_time = Time.now
+  dbm.reset_stats if conf[:native_stats]
+  start_time = Process.clock_gettime(Process::CLOCK_MONOTONIC)
   tasks = []
   (0...num_threads).each do |param_thid|
     th = Thread.new(param_thid) do |thid|
-      rnd_state = Random.new(thid)
+      keygen = KeyGenerator.new(num_iterations * num_threads, conf[:dist], conf[:zipf_theta], thid)
+      latencies = Array.new(num_iterations)
       (0...num_iterations).each do |i|
-        if is_random
-          key_num = rnd_state.rand(num_iterations * num_threads)
-        else
-          key_num = thid * num_iterations + i
-        end
-        key = "%08d" % key_num
-        dbm.set(key, key).or_die
+        key_num = keygen.next(thid * num_iterations + i)
+        op_start_time = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        yield(keygen, key_num)
+        latencies[i] = Process.clock_gettime(Process::CLOCK_MONOTONIC) - op_start_time
         seq = i + 1
-        if thid == 0 and seq % (num_iterations / 500) == 0
+        if thid == 0 and num_iterations >= 500 and seq % (num_iterations / 500) == 0
           print(".")
           if seq % (num_iterations / 10) == 0
             printf(" (%08d)\n", seq)
           end
         end
       end
+      latencies
     end
     tasks.push(th)
   end
+  latencies = []
   tasks.each do |th|
-    th.join
+    latencies.concat(th.value)
   end
-  dbm.synchronize(false).or_die
-  end_time = Time.now
-  elapsed = end_time - start_time
-  GC.start
-  mem_usage = Utility.get_memory_usage - start_mem_usage
-  printf("Setting done: num_records=%d file_size=%d time=%.3f qps=%.0f mem=%d\n",
-         dbm.count, (dbm.file_size or -1), elapsed,
-         num_iterations * num_threads / elapsed, mem_usage)
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start_time
+  end_gc_stat = GC.stat
+  mem_usage = Utility.get_memory_usage
+  latencies.sort!
+  percentile = lambda do |ratio|
+    latencies.empty? ? 0.0 :
+      latencies[[(latencies.size * ratio).ceil - 1, 0].max] * 1000000
+  end
+  result = {
+    "phase" => label,
+    "value_size" => conf[:value_size],
+    "concurrent" => conf[:concurrent],
+    "num_operations" => num_iterations * num_threads,
+    "time" => elapsed,
+    "qps" => num_iterations * num_threads / elapsed,
+    "p50" => percentile.call(0.5),
+    "p90" => percentile.call(0.9),
+    "p99" => percentile.call(0.99),
+    "p999" => percentile.call(0.999),
+    "max" => (latencies.last or 0.0) * 1000000,
+    "gc_count" => end_gc_stat[:count] - start_gc_stat[:count],
+    "gc_minor_count" => end_gc_stat[:minor_gc_count] - start_gc_stat[:minor_gc_count],
+    "gc_major_count" => end_gc_stat[:major_gc_count] - start_gc_stat[:major_gc_count],
+    "rss" => mem_usage,
+    "mem" => mem_usage - start_mem_usage,
+    "num_records" => dbm.count,
+    "file_size" => (dbm.file_size or -1),
+  }
+  result["native_stats"] = dbm.stats if conf[:native_stats]
+  printf("%s done: num_records=%d file_size=%d time=%.3f qps=%.0f mem=%d" +
+         " p50=%.1fus p99=%.1fus p999=%.1fus gc=%d\n",
+         label, result["num_records"], result["file_size"], elapsed, result["qps"],
+         result["mem"], result["p50"], result["p99"], result["p999"], result["gc_count"])
   printf("\n")
-  print("Getting:\n")
-  start_time = Time.now
-  tasks = []
-  (0...num_threads).each do |param_thid|
-    th = Thread.new(param_thid) do |thid|
-      rnd_state = Random.new(thid)
-      (0...num_iterations).each do |i|
-        if is_random
-          key_num = rnd_state.rand(num_iterations * num_threads)
-        else
-          key_num = thid * num_iterations + i
-        end
-        key = "%08d" % key_num
+  results.push(result)
+end
+
+
+# Makes a key string.
+def make_key(key_num)
+  "%08d" % key_num
+end
+
+
+# Makes a value string of the size.
+def make_value(key_num, value_size)
+  value = "%08d" % key_num
+  value * (value_size / value.size) + value[0, value_size % value.size]
+end
+
+
+# Runs the workloads on a database.
+def run_workloads(conf, results)
+  open_params = conf[:open_params].merge("truncate" => true)
+  open_params["concurrent"] = conf[:concurrent] if not conf[:concurrent].nil?
+  open_params["latency_stats"] = true if conf[:native_stats]
+  dbm = DBM.new
+  dbm.open(conf[:path], true, open_params).or_die
+  num_keys = conf[:num_iterations] * conf[:num_threads]
+  value_size = conf[:value_size]
+  conf[:workloads].each do |workload|
+    case workload
+    when "set"
+      run_phase("Setting", dbm, conf, results) do |keygen, key_num|
+        dbm.set(make_key(key_num), make_value(key_num, value_size)).or_die
+      end
+      dbm.synchronize(false).or_die
+    when "get"
+      run_phase("Getting", dbm, conf, results) do |keygen, key_num|
         status = Status.new
-        dbm.get(key, status)
+        dbm.get(make_key(key_num), status)
         if status != Status::NOT_FOUND_ERROR
           status.or_die
         end
-        seq = i + 1
-        if thid == 0 and seq % (num_iterations / 500) == 0
-          print(".")
-          if seq % (num_iterations / 10) == 0
-            printf(" (%08d)\n", seq)
-          end
+      end
+    when "remove"
+      run_phase("Removing", dbm, conf, results) do |keygen, key_num|
+        status = dbm.remove(make_key(key_num))
+        if status != Status::NOT_FOUND_ERROR
+          status.or_die
         end
       end
-    end
-    tasks.push(th)
-  end
-  tasks.each do |th|
-    th.join
-  end
-  end_time = Time.now
-  elapsed = end_time - start_time
-  GC.start
-  mem_usage = Utility.get_memory_usage - start_mem_usage
-  printf("Getting done: num_records=%d file_size=%d time=%.3f qps=%.0f mem=%d\n",
-         dbm.count, (dbm.file_size or -1), elapsed,
-         num_iterations * num_threads / elapsed, mem_usage)
-  printf("\n")
-  print("Removing:\n")
-  start_time = Time.now
-  tasks = []
-  (0...num_threads).each do |param_thid|
-    th = Thread.new(param_thid) do |thid|
-      rnd_state = Random.new(thid)
-      (0...num_iterations).each do |i|
-        if is_random
-          key_num = rnd_state.rand(num_iterations * num_threads)
+      dbm.synchronize(false).or_die
+    when "mixed"
+      read_ratio = conf[:read_ratio]
+      run_phase("Mixing", dbm, conf, results) do |keygen, key_num|
+        key = make_key(key_num)
+        if keygen.rand(1000000) < read_ratio * 1000000
+          status = Status.new
+          dbm.get(key, status)
+          if status != Status::NOT_FOUND_ERROR
+            status.or_die
+          end
         else
-          key_num = thid * num_iterations + i
+          dbm.set(key, make_value(key_num, value_size)).or_die
         end
-        key = "%08d" % key_num
-        status = Status.new
-        status = dbm.remove(key)
+      end
+    when "multi"
+      multi_size = conf[:multi_size]
+      run_phase("Multi-getting", dbm, conf, results) do |keygen, key_num|
+        keys = (0...multi_size).map { |i| make_key((key_num + i) % num_keys) }
+        dbm.get_multi(*keys)
+      end
+    when "process"
+      run_phase("Processing", dbm, conf, results) do |keygen, key_num|
+        status = dbm.process(make_key(key_num), true) do |key, value|
+          value ? value.succ : make_value(key_num, value_size)
+        end
+        status.or_die
+      end
+    when "iterate"
+      iter_conf = conf.merge(num_threads: 1, num_iterations: 1)
+      num_records = 0
+      run_phase("Iterating", dbm, iter_conf, results) do |keygen, key_num|
+        dbm.each do |key, value|
+          num_records += 1
+        end
+      end
+      results.last["num_iterated_records"] = num_records
+    when "async"
+      async = AsyncDBM.new(dbm, conf[:async_threads])
+      run_phase("Async-setting", dbm, conf, results) do |keygen, key_num|
+        async.set(make_key(key_num), make_value(key_num, value_size)).get.or_die
+      end
+      run_phase("Async-getting", dbm, conf, results) do |keygen, key_num|
+        status = async.get(make_key(key_num)).get[0]
         if status != Status::NOT_FOUND_ERROR
           status.or_die
         end
-        seq = i + 1
-        if thid == 0 and seq % (num_iterations / 500) == 0
-          print(".")
-          if seq % (num_iterations / 10) == 0
-            printf(" (%08d)\n", seq)
-          end
-        end
       end
+      async.destruct
+    else
+      raise ArgumentError, "unknown workload: #{workload}"
     end
-    tasks.push(th)
-  end
-  tasks.each do |th|
-    th.join
   end
-  dbm.synchronize(false).or_die
-  end_time = Time.now
-  elapsed = end_time - start_time
-  GC.start
-  mem_usage = Utility.get_memory_usage - start_mem_usage
-  printf("Removing done: num_records=%d file_size=%d time=%.3f qps=%.0f mem=%d\n",
-         dbm.count, (dbm.file_size or -1), elapsed,
-         num_iterations * num_threads / elapsed, mem_usage)
-  printf("\n")
   dbm.close.or_die
   dbm.destruct
+end
+
+
+# main routine
+def main
+  conf = {
+    path: "",
+    open_params: {},
+    num_iterations: 10000,
+    num_threads: 1,
+    dist: "sequential",
+    zipf_theta: 0.99,
+    workloads: ["set", "get", "remove"],
+    read_ratio: 0.9,
+    value_sizes: [8],
+    multi_size: 16,
+    async_threads: 4,
+    concurrent_modes: [nil],
+    native_stats: false,
+  }
+  open_params_expr = ""
+  json_path = nil
+  op = OptionParser.new
+  op.on('--path str') { |v| conf[:path] = v }
+  op.on('--params str') { |v| open_params_expr = v }
+  op.on('--iter num') { |v| conf[:num_iterations] = v.to_i }
+  op.on('--threads num') { |v| conf[:num_threads] = v.to_i }
+  op.on('--random') { conf[:dist] = "random" }
+  op.on('--zipf [theta]') { |v| conf[:dist] = "zipf"; conf[:zipf_theta] = v.to_f if v }
+  op.on('--workloads str') { |v| conf[:workloads] = v.split(",") }
+  op.on('--read_ratio num') { |v| conf[:read_ratio] = v.to_f }
+  op.on('--value_size list') { |v| conf[:value_sizes] = v.split(",").map(&:to_i) }
+  op.on('--multi num') { |v| conf[:multi_size] = v.to_i }
+  op.on('--async_threads num') { |v| conf[:async_threads] = v.to_i }
+  op.on('--both_modes') { conf[:concurrent_modes] = [false, true] }
+  op.on('--native_stats') { conf[:native_stats] = true }
+  op.on('--json path') { |v| json_path = v }
+  op.parse(ARGV)
+  open_params_expr.split(",").each do |expr|
+    columns = expr.split("=", 2)
+    if columns.size == 2
+      conf[:open_params][columns[0]] = columns[1]
+    end
+  end
+  printf("path: %s\n", conf[:path])
+  printf("params: %s\n", conf[:open_params])
+  printf("num_iterations: %d\n", conf[:num_iterations])
+  printf("num_threads: %d\n", conf[:num_threads])
+  printf("distribution: %s\n", conf[:dist])
+  printf("workloads: %s\n", conf[:workloads].join(","))
+  printf("value_sizes: %s\n", conf[:value_sizes].join(","))
+  printf("\n")
+  results = []
+  conf[:concurrent_modes].each do |concurrent|
+    conf[:value_sizes].each do |value_size|
+      if conf[:value_sizes].size > 1 or not concurrent.nil?
+        printf("== value_size=%d concurrent=%s ==\n\n", value_size,
+               concurrent.nil? ? conf[:open_params].fetch("concurrent", false) : concurrent)
+      end
+      run_workloads(conf.merge(value_size: value_size, concurrent: concurrent), results)
+    end
+  end
+  if json_path
+    report = {
+      "version" => Utility::VERSION,
+      "path" => conf[:path],
+      "params" => conf[:open_params],
+      "num_iterations" => conf[:num_iterations],
+      "num_threads" => conf[:num_threads],
+      "distribution" => conf[:dist],
+      "results" => results,
+    }
+    if json_path == "-"
+      puts(JSON.pretty_generate(report))
+    else
+      File.write(json_path, JSON.pretty_generate(report))
+    end
+  end
   return 0
 end
 
@@ -0,0 +1,189 @@
+#! /usr/bin/ruby -I. -w
+# -*- coding: utf-8 -*-
+
+require 'optparse'
+require 'tkrzw'
+
+include Tkrzw
+
+
+# Reads a trace file recorded by DBM#record_trace.
+def read_trace(path)
+  ops = []
+  File.foreach(path, mode: "rb") do |line|
+    fields = line.chomp.split("\t")
+    next if fields.size != 5
+    key = fields[3].gsub(/%([0-9A-Fa-f]{2})/) { [$1].pack("H2") }
+    ops.push([fields[0].to_i, fields[1].to_i, fields[2], key, fields[4].to_i])
+  end
+  ops
+end
+
+
+# Applies an operation of the trace to the database.
+# The context holds the state of a thread: cached values, the iterator, and the pending rekey.
+def apply_op(dbm, method, key, value_size, context)
+  values = context[:values]
+  value = value_size < 0 ? nil : (values[value_size] ||= "*" * value_size)
+  if method.start_with?("iterator_")
+    context[:iter] ||= dbm.make_iterator
+    return apply_iter_op(context[:iter], method, key, value)
+  end
+  case method
+  when "get"
+    dbm.get(key)
+  when "include"
+    dbm.include?(key)
+  when "set"
+    dbm.set(key, value)
+  when "append"
+    dbm.append(key, value)
+  when "remove"
+    dbm.remove(key)
+  when "increment"
+    dbm.increment(key, 1)
+  when "compare_exchange"
+    value ? dbm.set(key, value) : dbm.remove(key)
+  when "process"
+    # The block of the original process is unknown, so only the lookup is replayed.
+    dbm.get(key)
+  when "rekey"
+    context[:rekey_key] = key
+  when "rekey_to"
+    dbm.rekey(context.delete(:rekey_key) || key, key)
+  when "pop_first"
+    dbm.pop_first
+  when "push_last"
+    dbm.push_last(value || "")
+  when "each", "process_each"
+    # The blocks are unknown, so only the scans are replayed.
+    dbm.each { |rec_key, rec_value| }
+  when "parallel_each"
+    dbm.parallel_each
+  when "clear"
+    dbm.clear
+  end
+end
+
+
+# Applies an operation of an iterator in the trace.  Each thread replays with one iterator.
+def apply_iter_op(iter, method, key, value)
+  case method
+  when "iterator_first"
+    iter.first
+  when "iterator_last"
+    iter.last
+  when "iterator_jump"
+    iter.jump(key)
+  when "iterator_jump_lower"
+    iter.jump_lower(key)
+  when "iterator_jump_upper"
+    iter.jump_upper(key)
+  when "iterator_next"
+    iter.next
+  when "iterator_previous"
+    iter.previous
+  when "iterator_get"
+    iter.get
+  when "iterator_set"
+    iter.set(value || "")
+  when "iterator_remove"
+    iter.remove
+  when "iterator_step"
+    iter.step
+  end
+end
+
+
+# main routine
+def main
+  path = ""
+  trace_path = ""
+  open_params = {}
+  open_params_expr = ""
+  order = "strict"
+  truncate = false
+  op = OptionParser.new
+  op.on('--path str') { |v| path = v }
+  op.on('--params str') { |v| open_params_expr = v }
+  op.on('--trace str') { |v| trace_path = v }
+  op.on('--order str') { |v| order = v }
+  op.on('--truncate') { truncate = true }
+  op.parse(ARGV)
+  open_params_expr.split(",").each do |expr|
+    columns = expr.split("=", 2)
+    if columns.size == 2
+      open_params[columns[0]] = columns[1]
+    end
+  end
+  if not ["strict", "timed", "free"].include?(order)
+    raise ArgumentError, "unknown order: #{order}"
+  end
+  ops = read_trace(trace_path)
+  thread_ops = {}
+  ops.each_with_index do |(elapsed, thid, method, key, value_size), seq|
+    (thread_ops[thid] ||= []).push([seq, elapsed, method, key, value_size])
+  end
+  printf("path: %s\n", path)
+  printf("params: %s\n", open_params)
+  printf("trace: %s\n", trace_path)
+  printf("order: %s\n", order)
+  printf("num_operations: %d\n", ops.size)
+  printf("num_threads: %d\n", thread_ops.size)
+  printf("\n")
+  open_params["truncate"] = true if truncate
+  GC.start
+  start_mem_usage = Utility.get_memory_usage
+  dbm = DBM.new
+  dbm.open(path, true, open_params).or_die
+  print("Replaying:\n")
+  mutex = Mutex.new
+  cond = ConditionVariable.new
+  next_seq = 0
+  start_time = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  tasks = []
+  thread_ops.each_value do |param_ops|
+    th = Thread.new(param_ops) do |my_ops|
+      context = {values: {}}
+      my_ops.each do |seq, elapsed, method, key, value_size|
+        case order
+        when "strict"
+          # Waits for the preceding operations of all threads to be done.
+          mutex.synchronize do
+            cond.wait(mutex) while next_seq != seq
+          end
+        when "timed"
+          delay = start_time + elapsed / 1000000.0 - Process.clock_gettime(Process::CLOCK_MONOTONIC)
+          sleep(delay) if delay > 0
+        end
+        apply_op(dbm, method, key, value_size, context)
+        if order == "strict"
+          mutex.synchronize do
+            next_seq += 1
+            cond.broadcast
+          end
+        end
+      end
+    end
+    tasks.push(th)
+  end
+  tasks.each do |th|
+    th.join
+  end
+  dbm.synchronize(false).or_die
+  end_time = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  elapsed = end_time - start_time
+  mem_usage = Utility.get_memory_usage - start_mem_usage
+  printf("Replaying done: num_records=%d file_size=%d time=%.3f qps=%.0f mem=%d\n",
+         dbm.count, (dbm.file_size or -1), elapsed, ops.size / elapsed, mem_usage)
+  printf("\n")
+  dbm.close.or_die
+  return 0
+end
+
+
+STDOUT.sync = true
+exit(main)
+
+
+# END OF FILE
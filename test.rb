@@ -2,6 +2,7 @@
 # -*- coding: utf-8 -*-
 
 require 'fileutils'
+require 'objspace'
 require 'test/unit'
 require 'tkrzw'
 require 'tmpdir'
@@ -157,6 +158,10 @@ class TkrzwTest < Test::Unit::TestCase
       inspect = dbm.inspect_details
       class_name = inspect["class"]
       assert_equal(conf[:expected_class], class_name)
+      metrics = dbm.metrics
+      assert_equal(class_name, metrics["class"])
+      assert_equal(0, metrics["num_records"])
+      assert_true(metrics["file_size"].is_a?(Integer))
       (0...20).each do |i|
         key = "%08d" % i
         value = "%d" % i
@@ -231,6 +236,12 @@ class TkrzwTest < Test::Unit::TestCase
         assert_equal(Status::SUCCESS, status)
         records[key] = value
       end
+      assert_equal(records, dbm.get_multi(*records.keys))
+      multi_records = {"multi-a" => "1", "multi-b" => "2", "multi-c" => "3"}
+      assert_equal(Status::SUCCESS, dbm.set_multi(**multi_records))
+      assert_equal(multi_records, dbm.get_multi(*multi_records.keys, "multi-x"))
+      assert_equal(Status::SUCCESS, dbm.remove_multi(*multi_records.keys))
+      assert_equal(Status::NOT_FOUND_ERROR, dbm.remove_multi("multi-a", "multi-x"))
       assert_equal(Status::SUCCESS, dbm.rebuild(**conf[:rebuild_params]))
       assert_true([true, false].include?(dbm.should_be_rebuilt?))
       iter_records = {}
@@ -259,6 +270,17 @@ class TkrzwTest < Test::Unit::TestCase
         iter_records[key] = value
       end
       assert_equal(records, iter_records)
+      iter_records = {}
+      status = dbm.parallel_each(batch_size: 3) do |batch|
+        assert_true(batch.size <= 3)
+        batch.each do |key, value|
+          iter_records[key] = value
+        end
+      end
+      assert_equal(Status::SUCCESS, status)
+      assert_equal(records, iter_records)
+      status, stats = dbm.parallel_each(threads: 2)
+      assert_equal(Status::INFEASIBLE_ERROR, status)
       if dbm.ordered?
         assert_equal(Status::SUCCESS, iter.last)
         iter_records = {}
@@ -298,6 +320,24 @@ class TkrzwTest < Test::Unit::TestCase
           iter_records[key] = value
         end
         assert_equal(records, iter_records)
+        sharded = open_params.has_key?(:num_shards)
+        iter_records = {}
+        status = copy_dbm.parallel_each(threads: 4, batch_size: 3) do |batch|
+          batch.each do |key, value|
+            iter_records[key] = value
+          end
+        end
+        if sharded
+          assert_equal(Status::SUCCESS, status)
+          assert_equal(records, iter_records)
+        else
+          assert_equal(Status::INFEASIBLE_ERROR, status)
+          assert_equal(0, iter_records.size)
+        end
+        status, stats = copy_dbm.parallel_each(threads: sharded ? 4 : 1)
+        assert_equal(Status::SUCCESS, status)
+        assert_equal(records.size, stats["count"])
+        assert_equal(records.keys.sum(&:size), stats["key_size"])
         assert_equal(Status::SUCCESS, copy_dbm.close)
         if ["HashDBM", "TreeDBM"].include?(class_name)
           restored_path = copy_path + "-restored"
@@ -668,6 +708,364 @@ class TkrzwTest < Test::Unit::TestCase
     dbm.destruct
   end
 
+  # Fork tests.
+  def test_fork
+    omit("fork is not supported") unless Process.respond_to?(:fork)
+    path = _make_tmp_path("casket.tkh")
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open(path, true, truncate: true, num_buckets: 100))
+    assert_equal(Status::SUCCESS, dbm.set("one", "first"))
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(path, false, reopen_on_fork: true))
+    pid = fork do
+      exit!(dbm.writable? || dbm.get("one") != "first" ? 1 : 0)
+    end
+    Process.waitpid(pid)
+    assert_equal(0, $?.exitstatus)
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(path, false))
+    pid = fork do
+      status = dbm.after_fork
+      exit!(status == Status::SUCCESS && dbm.get("one") == "first" ? 0 : 1)
+    end
+    Process.waitpid(pid)
+    assert_equal(0, $?.exitstatus)
+    assert_equal("first", dbm.get("one"))
+    assert_equal(Status::SUCCESS, dbm.close)
+    shard_path = _make_tmp_path("casket-shard.tkh")
+    assert_equal(Status::SUCCESS, dbm.open(shard_path, true, truncate: true, num_shards: 4))
+    assert_equal(Status::SUCCESS, dbm.set_multi("a" => "1", "b" => "2", "c" => "3"))
+    pid = fork do
+      records = dbm.get_multi("a", "b", "c")
+      status = dbm.after_fork
+      exit!(records == {"a" => "1", "b" => "2", "c" => "3"} &&
+            status == Status::PRECONDITION_ERROR && dbm.writable? ? 0 : 1)
+    end
+    Process.waitpid(pid)
+    assert_equal(0, $?.exitstatus)
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(shard_path, false, num_shards: 0))
+    pid = fork do
+      status = dbm.after_fork
+      records = dbm.get_multi("a", "b", "c")
+      exit!(status == Status::SUCCESS && !dbm.writable? &&
+            records == {"a" => "1", "b" => "2", "c" => "3"} ? 0 : 1)
+    end
+    Process.waitpid(pid)
+    assert_equal(0, $?.exitstatus)
+    assert_equal(Status::SUCCESS, dbm.close)
+    mem_path = _make_tmp_path("casket.tkmt")
+    assert_equal(Status::SUCCESS, dbm.open(mem_path, true, truncate: true))
+    assert_equal(Status::SUCCESS, dbm.set("two", "second"))
+    pid = fork do
+      status = dbm.after_fork
+      exit!(status == Status::SUCCESS && dbm.get("two") == "second" &&
+            dbm.set("three", "third") == Status::SUCCESS ? 0 : 1)
+    end
+    Process.waitpid(pid)
+    assert_equal(0, $?.exitstatus)
+    assert_equal(Status::SUCCESS, dbm.close)
+    dbm.destruct
+  end
+
+  # Stats tests.
+  def test_stats
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM"))
+    assert_false(dbm.stats.include?("get"))
+    assert_equal(0, dbm.stats["gvl"]["calls"])
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM", concurrent: true))
+    assert_equal(Status::SUCCESS, dbm.set("one", "first"))
+    assert_equal("first", dbm.get("one"))
+    gvl_stats = dbm.stats["gvl"]
+    assert_true(gvl_stats["calls"] >= 2)
+    assert_true(gvl_stats["native_time"] >= 0)
+    assert_true(gvl_stats["wait_time"] >= 0)
+    assert_true(gvl_stats["max_wait_time"] <= gvl_stats["wait_time"])
+    dbm.reset_stats
+    assert_equal(0, dbm.stats["gvl"]["calls"])
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM", latency_stats: true))
+    (0...100).each do |i|
+      assert_equal(Status::SUCCESS, dbm.set(i, i))
+      assert_equal(i.to_s, dbm.get(i))
+    end
+    assert_equal(Status::SUCCESS, dbm.remove(0))
+    dbm.each do |key, value|
+    end
+    stats = dbm.stats
+    assert_equal(100, stats["set"]["count"])
+    assert_equal(100, stats["get"]["count"])
+    assert_equal(1, stats["remove"]["count"])
+    assert_true(stats["iterate"]["count"] > 0)
+    assert_equal(0, stats["rebuild"]["count"])
+    get_stats = stats["get"]
+    assert_true(get_stats["p50"] <= get_stats["p90"])
+    assert_true(get_stats["p90"] <= get_stats["p99"])
+    assert_true(get_stats["p99"] <= get_stats["p999"])
+    assert_true(get_stats["p999"] <= get_stats["max"])
+    dbm.reset_stats
+    assert_equal(0, dbm.stats["get"]["count"])
+    assert_equal(Status::SUCCESS, dbm.close)
+  end
+
+  def test_memsize
+    dbm = DBM.new
+    empty_size = ObjectSpace.memsize_of(dbm)
+    assert_true(empty_size > 0)
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM"))
+    (0...5000).each do |i|
+      assert_equal(Status::SUCCESS, dbm.set(i, "x" * 100))
+    end
+    assert_true(ObjectSpace.memsize_of(dbm) > empty_size + 5000 * 100)
+    assert_equal(Status::SUCCESS, dbm.clear)
+    assert_equal(empty_size, ObjectSpace.memsize_of(dbm))
+    assert_equal(Status::SUCCESS, dbm.close)
+    index = Index.new
+    assert_equal(Status::SUCCESS, index.open("", true))
+    (0...2000).each do |i|
+      assert_equal(Status::SUCCESS, index.add(i.to_s, "x" * 100))
+    end
+    assert_true(ObjectSpace.memsize_of(index) > 1000 * 100)
+    assert_equal(Status::SUCCESS, index.close)
+    assert_true(ObjectSpace.memsize_of(Status.new(Status::SUCCESS, "hello")) > 5)
+  end
+
+  def test_gc_compaction
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM", encoding: "UTF-8"))
+    assert_equal(Status::SUCCESS, dbm.set("one", "first"))
+    iter = dbm.make_iterator
+    dbm = nil
+    GC.start
+    GC.compact if GC.respond_to?(:compact)
+    assert_equal(Status::SUCCESS, iter.first)
+    key, value = iter.get
+    assert_equal("one", key)
+    assert_equal("first", value)
+    assert_equal(Encoding::UTF_8, value.encoding)
+  end
+
+  def test_read_cache
+    path = _make_tmp_path("casket.tkh")
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open(
+                   path, true, truncate: true, read_cache: {capacity: 100, max_value_size: 8}))
+    (0...10).each do |i|
+      assert_equal(Status::SUCCESS, dbm.set(i, i * i))
+    end
+    assert_equal(Status::SUCCESS, dbm.set("big", "x" * 9))
+    assert_equal("4", dbm.get("2"))
+    assert_equal("4", dbm.get("2"))
+    assert_equal("xxxxxxxxx", dbm.get("big"))
+    assert_equal("xxxxxxxxx", dbm.get("big"))
+    assert_equal(nil, dbm.get("none"))
+    stats = dbm.stats["read_cache"]
+    assert_equal(1, stats["hits"])
+    assert_equal(4, stats["misses"])
+    assert_equal(1, stats["count"])
+    metrics = dbm.metrics
+    assert_equal(1, metrics["read_cache_hits"])
+    assert_equal(4, metrics["read_cache_misses"])
+    assert_false(metrics.include?("bloom_filter_negatives"))
+    assert_equal(Status::SUCCESS, dbm.set("2", "two"))
+    assert_equal("two", dbm.get("2"))
+    assert_equal({"2" => "two", "3" => "9"}, dbm.get_multi("2", "3"))
+    assert_equal("two", dbm["2"])
+    assert_equal(Status::SUCCESS, dbm.append("2", "2", ":"))
+    assert_equal("two:2", dbm.get("2"))
+    assert_equal(Status::SUCCESS, dbm.remove("2"))
+    assert_equal(nil, dbm.get("2"))
+    assert_false(dbm.include?("2"))
+    assert_true(dbm.include?("3"))
+    count = dbm.stats["read_cache"]["count"]
+    assert_true(dbm.include?("5"))
+    assert_equal(count, dbm.stats["read_cache"]["count"])
+    assert_raise(RuntimeError) { AsyncDBM.new(dbm, 1) }
+    assert_equal(Status::SUCCESS, dbm.set_multi("3" => "three"))
+    assert_equal("three", dbm.get("3"))
+    iter = dbm.make_iterator
+    assert_equal(Status::SUCCESS, iter.jump("3"))
+    assert_equal(Status::SUCCESS, iter.set("drei"))
+    assert_equal("drei", dbm.get("3"))
+    assert_equal(Status::SUCCESS, iter.jump("3"))
+    assert_equal(Status::SUCCESS, iter.remove)
+    assert_equal(nil, dbm.get("3"))
+    assert_equal("16", dbm.get("4"))
+    assert_equal(Status::SUCCESS, dbm.clear)
+    assert_equal(nil, dbm.get("4"))
+    assert_equal(0, dbm.stats["read_cache"]["count"])
+    dbm.reset_stats
+    assert_equal(0, dbm.stats["read_cache"]["hits"])
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(path, true))
+    assert_false(dbm.stats.include?("read_cache"))
+    assert_equal(Status::SUCCESS, dbm.close)
+  end
+
+  def test_intern_values
+    path = _make_tmp_path("casket.tkh")
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open(
+                   path, true, truncate: true, encoding: "UTF-8", intern_values: 8))
+    assert_equal(Status::SUCCESS, dbm.set("one", "active"))
+    assert_equal(Status::SUCCESS, dbm.set("two", "active"))
+    assert_equal(Status::SUCCESS, dbm.set("three", "x" * 9))
+    value = dbm.get("one")
+    assert_equal("active", value)
+    assert_true(value.frozen?)
+    assert_equal(Encoding::UTF_8, value.encoding)
+    assert_same(value, dbm.get("two"))
+    assert_same(value, dbm["one"])
+    assert_false(dbm.get("three").frozen?)
+    dbm.each do |rec_key, rec_value|
+      assert_false(rec_key.frozen?)
+      assert_equal(rec_value.size <= 8, rec_value.frozen?)
+    end
+    iter = dbm.make_iterator
+    assert_equal(Status::SUCCESS, iter.jump("one"))
+    assert_same(value, iter.get_value)
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(path, true))
+    assert_false(dbm.get("one").frozen?)
+    assert_equal(Status::SUCCESS, dbm.close)
+  end
+
+  def test_bloom_filter
+    path = _make_tmp_path("casket.tkh")
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open(path, true, truncate: true))
+    (0...10).each do |i|
+      assert_equal(Status::SUCCESS, dbm.set(i, i * i))
+    end
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(
+                   path, true, bloom_filter: {capacity: 1000, error_rate: 0.001}))
+    stats = dbm.stats["bloom_filter"]
+    assert_equal(1000, stats["capacity"])
+    assert_true(stats["num_bits"] > 1000)
+    assert_true(stats["num_hashes"] > 0)
+    assert_equal("4", dbm.get("2"))
+    assert_true(dbm.include?("3"))
+    assert_equal(Status::SUCCESS, dbm.set("new", "value"))
+    assert_equal("value", dbm["new"])
+    assert_equal({"2" => "4", "new" => "value"}, dbm.get_multi("2", "new", "none"))
+    (0...100).each do |i|
+      assert_equal(nil, dbm.get("none-#{i}"))
+      assert_false(dbm.include?("none-#{i}"))
+    end
+    stats = dbm.stats["bloom_filter"]
+    assert_true(stats["negatives"] > 150)
+    assert_true(stats["lookups"] >= stats["negatives"])
+    assert_raise(RuntimeError) { AsyncDBM.new(dbm, 1) }
+    metrics = dbm.metrics
+    assert_equal(stats["negatives"], metrics["bloom_filter_negatives"])
+    assert_equal(stats["lookups"], metrics["bloom_filter_lookups"])
+    assert_false(metrics.include?("read_cache_hits"))
+    assert_equal(Status::SUCCESS, dbm.remove("2"))
+    assert_equal(nil, dbm.get("2"))
+    assert_equal(Status::SUCCESS, dbm.push_last("queued"))
+    queued_key = nil
+    dbm.each { |key, value| queued_key = key if value == "queued" }
+    assert_true(dbm.include?(queued_key))
+    assert_equal("queued", dbm.get(queued_key))
+    assert_equal(1000, dbm.stats["bloom_filter"]["capacity"])
+    dbm.reset_stats
+    assert_equal(0, dbm.stats["bloom_filter"]["lookups"])
+    assert_equal(Status::SUCCESS, dbm.close)
+    assert_equal(Status::SUCCESS, dbm.open(path, true, bloom_filter: true))
+    assert_equal("value", dbm.get("new"))
+    assert_equal(Status::SUCCESS, dbm.close)
+  end
+
+  def test_trace
+    trace_path = _make_tmp_path("casket.trace")
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM"))
+    assert_equal(Status::SUCCESS, dbm.record_trace(trace_path))
+    assert_equal(Status::SUCCESS, dbm.set("one", "first"))
+    assert_equal("first", dbm.get("one"))
+    assert_equal(nil, dbm.get("two"))
+    assert_equal(Status::SUCCESS, dbm.set_multi("two" => "second", "a\tb" => "ab"))
+    assert_equal(Status::SUCCESS, dbm.remove("one"))
+    assert_equal(Status::SUCCESS, dbm.record_trace(nil))
+    assert_equal(Status::SUCCESS, dbm.set("three", "third"))
+    lines = File.read(trace_path).split("\n").map { |line| line.split("\t") }
+    assert_equal(["set", "get", "get", "set", "set", "remove"], lines.map { |f| f[2] })
+    assert_equal(["one", "one", "two", "a%09b", "two", "one"], lines.map { |f| f[3] })
+    assert_equal(["5", "5", "-1", "2", "6", "-1"], lines.map { |f| f[4] })
+    assert_equal(1, lines.map { |f| f[1] }.uniq.size)
+    assert_equal(lines.map { |f| f[0].to_i }.sort, lines.map { |f| f[0].to_i })
+    assert_equal(Status::SUCCESS, dbm.record_trace(trace_path))
+    assert_equal("second", dbm.get("two"))
+    Thread.new { dbm.get("two") }.join
+    assert_equal(Status::SUCCESS, dbm.record_trace(nil))
+    lines = File.read(trace_path).split("\n").map { |line| line.split("\t") }
+    assert_equal(2, lines.size)
+    assert_equal(2, lines.map { |f| f[1] }.uniq.size)
+    assert_equal(Status::SUCCESS, dbm.record_trace(trace_path))
+    assert_equal(Status::SUCCESS, dbm.rekey("three", "four"))
+    iter = dbm.make_iterator
+    assert_equal(Status::SUCCESS, iter.jump("four"))
+    assert_equal(["four", "third"], iter.get)
+    dbm.each { |key, value| }
+    assert_equal(Status::SUCCESS, dbm.clear)
+    assert_equal(Status::SUCCESS, dbm.record_trace(nil))
+    lines = File.read(trace_path).split("\n").map { |line| line.split("\t") }
+    assert_equal(["rekey", "rekey_to", "iterator_jump", "iterator_get", "each", "clear"],
+                 lines.map { |f| f[2] })
+    assert_equal(["three", "four", "four", "four", "", ""], lines.map { |f| f[3] })
+    assert_equal(Status::SUCCESS, dbm.close)
+  end
+
+  # Pool tests.
+  def test_pool
+    path = _make_tmp_path("casket.tkh")
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open(path, true, truncate: true))
+    assert_equal(Status::SUCCESS, dbm.set("one", "first"))
+    assert_equal(Status::SUCCESS, dbm.close)
+    pool = Pool.new
+    assert_equal(Status::INVALID_ARGUMENT_ERROR, pool.open(path, true, num_readers: 3))
+    assert_equal(Status::SUCCESS, pool.open(path, false, num_readers: 3))
+    assert_equal(3, pool.num_readers)
+    assert_equal(3, pool.num_available)
+    readers = []
+    3.times do
+      reader = pool.checkout
+      assert_false(reader.writable?)
+      readers.push(reader)
+    end
+    assert_equal(0, pool.num_available)
+    assert_equal(nil, pool.checkout)
+    assert_equal(Status::PRECONDITION_ERROR, pool.close)
+    waiter = Thread.new do
+      pool.with_reader { |reader| reader.get("one") }
+    end
+    sleep(0.1)
+    readers.each do |reader|
+      pool.checkin(reader)
+    end
+    assert_equal("first", waiter.value)
+    assert_raise(RuntimeError) { pool.checkin(readers[0]) }
+    assert_raise(RuntimeError) { pool.checkin(dbm) }
+    threads = []
+    5.times do
+      threads.push(Thread.new do
+        10.times do
+          assert_equal("first", pool.with_reader { |reader| reader.get("one") })
+        end
+      end)
+    end
+    threads.each do |th|
+      th.join
+    end
+    assert_equal(3, pool.num_available)
+    assert_true(pool.inspect.include?("3/3"))
+    assert_equal(Status::SUCCESS, pool.close)
+  end
+
   # Search tests.
   def test_search
     confs = [
@@ -926,15 +1324,123 @@ class TkrzwTest < Test::Unit::TestCase
     status = Status.new
     assert_equal(nil, file.read(1024, 10, status))
     assert_equal(Status::INFEASIBLE_ERROR, status)
+    buf = "xyz"
+    assert_equal(Status::SUCCESS, file.read_into(2, 6, buf))
+    assert_equal("CDE123", buf)
+    assert_equal(Status::INFEASIBLE_ERROR, file.read_into(1024, 10, buf))
+    assert_raise(TypeError) { file.read_into(0, 1, 123) }
+    assert_equal(["AB", "E12", nil, ""], file.read_multi([[0, 2], [4, 3], [1024, 1], [1, 0]]))
+    assert_equal(Status::SUCCESS, file.write_multi([[0, "ab"], [10, "fg"]]))
+    assert_equal(["abCDE12345fg"], file.read_multi([[0, 12]], status))
+    assert_equal(Status::SUCCESS, status)
+    assert_equal(Status::SUCCESS, file.write_multi([[0, "AB"], [10, "FG"]]))
+    assert_raise(ArgumentError) { file.read_multi([0, 2]) }
+    if defined?(IO::Buffer) and RUBY_VERSION >= "3.2"
+      io_buf = IO::Buffer.new(8)
+      assert_equal(Status::SUCCESS, file.read_into(1, 5, io_buf))
+      assert_equal("BCDE1", io_buf.get_string(0, 5))
+      assert_equal(Status::INVALID_ARGUMENT_ERROR, file.read_into(0, 9, io_buf))
+      io_buf = file.pread_buffer(5, 4)
+      assert_equal(4, io_buf.size)
+      assert_equal("1234", io_buf.get_string)
+      assert_equal(nil, file.pread_buffer(1024, 10, status))
+      assert_equal(Status::INFEASIBLE_ERROR, status)
+    end
     assert_equal(Status::SUCCESS, file.close)
     assert_equal(Status::SUCCESS, file.open(path, false))
     assert_equal(512, file.get_size)
     assert_equal("E12345F", file.read(4, 7))
+    buf = "x" * 100
+    shared_buf = buf.dup
+    assert_equal(Status::SUCCESS, file.read_into(0, 100, buf))
+    assert_equal("ABCDE12345FG", buf[0, 12])
+    assert_equal("x" * 100, shared_buf)
+    assert_raise(FrozenError) { file.read_into(0, 100, shared_buf.freeze) }
     assert_equal(Status::SUCCESS, file.close)
     file.destruct
     assert_true(file.inspect.include?("Tkrzw::File"))
   end
 
+  def test_asyncfile
+    file = Tkrzw::File.new
+    path = _make_tmp_path("casket.txt")
+    assert_equal(Status::SUCCESS, file.open(path, true, truncate: true, concurrent: true))
+    async = AsyncFile.new(file, 4)
+    assert_true(async.inspect.include?("Tkrzw::AsyncFile"))
+    assert_true(async.to_s.index("AsyncFile") != nil)
+    assert_equal(Status::SUCCESS, async.write(0, "ABCDE").get)
+    append_result = async.append("FGH").get
+    assert_equal(Status::SUCCESS, append_result[0])
+    assert_equal(5, append_result[1])
+    futures = (0...10).map { |i| async.append("%02d" % i) }
+    offsets = futures.map { |future| future.get[1] }
+    assert_equal((0...10).map { |i| 8 + i * 2 }, offsets.sort)
+    read_result = async.read(0, 8).get
+    assert_equal(Status::SUCCESS, read_result[0])
+    assert_equal("ABCDEFGH", read_result[1])
+    assert_equal(Status::INFEASIBLE_ERROR, async.read(1024, 8).get[0])
+    assert_equal(Status::SUCCESS, async.synchronize(false).get)
+    assert_equal(Status::PRECONDITION_ERROR, file.close)
+    async.destruct
+    assert_true(async.inspect.include?("destructed"))
+    assert_raise(RuntimeError) { async.read(0, 1) }
+    assert_equal(28, file.get_size)
+    assert_equal(Status::SUCCESS, file.close)
+    assert_equal(Status::SUCCESS, file.open(path, false))
+    async = AsyncFile.new(file, 2)
+    file.destruct
+    assert_equal([Status::SUCCESS, "ABCDEFGH"], async.read(0, 8).get)
+    async.destruct
+  end
+
+  def test_file_each_line
+    file = Tkrzw::File.new
+    path = _make_tmp_path("casket.txt")
+    assert_equal(Status::SUCCESS, file.open(path, true, truncate: true))
+    lines = (0...100).map { |i| "line-#{i}" }
+    assert_equal(Status::SUCCESS, file.write(0, lines.join("\n")))
+    batches = []
+    offsets = []
+    status = file.each_line(batch_size: 30, chunk_size: 64) do |batch, offset|
+      batches.push(batch)
+      offsets.push(offset)
+    end
+    assert_equal(Status::SUCCESS, status)
+    assert_equal(lines, batches.flatten)
+    assert_true(batches.all? { |batch| batch.size <= 30 })
+    assert_equal(file.get_size, offsets.last)
+    resumed = []
+    file.each_line(start_offset: offsets[0]) do |batch, offset|
+      resumed.concat(batch)
+    end
+    assert_equal(lines[batches[0].size..-1], resumed)
+    count = 0
+    file.each_line(batch_size: 1) do |batch, offset|
+      count += 1
+      break
+    end
+    assert_equal(1, count)
+    assert_raise(ArgumentError) { file.each_line }
+    matches = []
+    status = file.search("end", "7", threads: 3, batch_size: 2, chunk_size: 50) do |batch|
+      assert_true(batch.size <= 2)
+      matches.concat(batch)
+    end
+    assert_equal(Status::SUCCESS, status)
+    expected = lines.each_with_index.select { |line, i| line.end_with?("7") }.map do |line, i|
+      [line, lines[0, i].sum { |prev| prev.size + 1 }]
+    end
+    assert_equal(expected, matches.sort_by { |line, offset| offset })
+    matches = []
+    file.search("regex", "^line-[0-3]$", threads: 2) { |batch| matches.concat(batch) }
+    assert_equal(["line-0", "line-1", "line-2", "line-3"], matches.map(&:first).sort)
+    matches = []
+    file.search("contain", "line", 5) { |batch| matches.concat(batch) }
+    assert_equal(5, matches.size)
+    assert_equal(Status::INVALID_ARGUMENT_ERROR, file.search("edit", "line") { |batch| })
+    assert_equal(Status::SUCCESS, file.close)
+  end
+
   # Index tests.
   def test_index
     index = Tkrzw::Index.new
@@ -1033,6 +1539,96 @@ class TkrzwTest < Test::Unit::TestCase
     index.destruct
     assert_true(index.inspect.include?("Tkrzw::Index"))
   end
+
+  def test_index_multi
+    index = Tkrzw::Index.new
+    path = _make_tmp_path("casket.tkt")
+    assert_equal(Status::SUCCESS, index.open(path, true, truncate: true))
+    records = (0...100).map { |i| ["key-#{i % 10}", "%03d" % i] }.shuffle
+    assert_equal(Status::SUCCESS, index.add_multi(records))
+    assert_equal(100, index.count)
+    assert_equal((0...10).map { |i| "%03d" % (i * 10 + 3) }, index.get_values("key-3"))
+    assert_equal(Status::SUCCESS, index.add_multi([]))
+    values = index.get_values_multi(["key-3", "key-1", "none", "key-3"], 2)
+    assert_equal({"key-1" => ["001", "011"], "key-3" => ["003", "013"], "none" => []}, values)
+    assert_equal(10, index.get_values_multi(["key-9"])["key-9"].size)
+    assert_equal(Status::SUCCESS, index.add_multi(
+                   [["even", "002"], ["even", "004"], ["even", "006"], ["even", "008"],
+                    ["big", "005"], ["big", "006"], ["big", "007"], ["big", "008"]]))
+    assert_equal(["006", "008"], index.intersect(["even", "big"]))
+    assert_equal(["006"], index.intersect(["even", "big"], 1))
+    assert_equal(["006"], index.intersect(["key-6", "even", "big"]))
+    assert_equal([], index.intersect(["even", "none"]))
+    assert_equal([], index.intersect([]))
+    assert_equal(["002", "004", "005", "006", "007", "008"], index.union(["even", "big"]))
+    assert_equal(["002", "004", "005"], index.union(["even", "none", "big"], 3))
+    assert_equal([], index.union(["none"]))
+    batches = []
+    index.each_range("key-5", "020", "060", 2) { |values| batches.push(values) }
+    assert_equal([["025", "035"], ["045", "055"]], batches)
+    batches = []
+    index.each_range("big") { |values| batches.push(values) }
+    assert_equal([["005", "006", "007", "008"]], batches)
+    index.each_range("none") { |values| batches.push(values) }
+    assert_equal(1, batches.size)
+    iter = index.make_iterator
+    iter.jump("big")
+    assert_equal([["big", "005"], ["big", "006"], ["big", "007"]], iter.get_batch(3))
+    assert_equal([["big", "008"], ["even", "002"]], iter.get_batch(2))
+    iter.last
+    assert_equal(1, iter.get_batch(10).size)
+    assert_equal([], iter.get_batch(10))
+    assert_equal(Status::NOT_FOUND_ERROR,
+                 index.remove_multi([["key-3", "003"], ["key-3", "none"], ["key-3", "013"]]))
+    assert_equal(106, index.count)
+    assert_false(index.include?("key-3", "013"))
+    assert_raise(ArgumentError) { index.add_multi([["key"]]) }
+    assert_equal(Status::SUCCESS, index.close)
+  end
+
+  def test_attach_index
+    dbm = DBM.new
+    assert_equal(Status::SUCCESS, dbm.open("", true, dbm: "TinyDBM"))
+    index = Tkrzw::Index.new
+    assert_equal(Status::SUCCESS, index.open("", true))
+    dbm.attach_index(index, {"prefix" => "user:", "delimiter" => ",", "column" => 1})
+    assert_equal(Status::SUCCESS, dbm.set("1", "user:alice,tokyo"))
+    assert_equal(Status::SUCCESS, dbm.set_multi(
+                   "2" => "user:bob,osaka", "3" => "user:carol,tokyo"))
+    assert_equal(Status::SUCCESS, dbm.set("4", "group:admin,tokyo"))
+    assert_equal(Status::DUPLICATION_ERROR, dbm.set("1", "user:alice,kyoto", false))
+    assert_equal(["1", "3"], index.get_values("tokyo"))
+    assert_equal(["2"], index.get_values("osaka"))
+    dbm["1"] = "user:alice,osaka"
+    assert_equal(["3"], index.get_values("tokyo"))
+    assert_equal(["1", "2"], index.get_values("osaka"))
+    assert_equal(Status::SUCCESS, dbm.append("3", "nara", ","))
+    assert_equal(["3"], index.get_values("tokyo"))
+    assert_equal(Status::SUCCESS, dbm.remove("2"))
+    assert_equal(Status::NOT_FOUND_ERROR, dbm.remove("2"))
+    assert_equal("user:alice,osaka", dbm.delete("1"))
+    assert_equal([], index.get_values("osaka"))
+    assert_equal(Status::SUCCESS, dbm.process("5", true) { |key, value| "user:dave,kobe" })
+    assert_equal(["5"], index.get_values("kobe"))
+    assert_equal(Status::SUCCESS, dbm.remove_multi(["3", "5"]))
+    assert_equal(0, index.count)
+    assert_raise(RuntimeError) { dbm.increment("counter", 1) }
+    assert_raise(RuntimeError) { dbm.clear }
+    assert_raise(RuntimeError) { dbm.process_each(true) { |key, value| nil } }
+    assert_equal(Status::SUCCESS, dbm.process_each(false) { |key, value| nil })
+    status = dbm.process("7", true) do |key, value|
+      dbm.detach_index
+      "user:frank,nara"
+    end
+    assert_equal(Status::SUCCESS, status)
+    assert_equal(["7"], index.get_values("nara"))
+    assert_equal(Status::SUCCESS, index.remove("nara", "7"))
+    assert_equal(0, index.count)
+    assert_equal(Status::SUCCESS, dbm.set("6", "user:eve,tokyo"))
+    assert_equal(0, index.count)
+    assert_equal(Status::SUCCESS, index.close)
+    assert_equal(Status::SUCCESS, dbm.close)
+  end
 end
 
 
@@ -365,7 +365,12 @@ module Tkrzw
     # For the file "PositionalParallelFile" and "PositionalAtomicFile", these optional parameters are supported.
     # - block_size (int): The block size to which all blocks should be aligned.
     # - access_options (str): Values separated by colon.  "direct" for direct I/O.  "sync" for synchrnizing I/O, "padding" for file size alignment by padding, "pagecache" for the mini page cache in the process.
-    # If the optional parameter "num_shards" is set, the database is sharded into multiple shard files.  Each file has a suffix like "-00003-of-00015".  If the value is 0, the number of shards is set by patterns of the existing files, or 1 if they doesn't exist.
+    # If the optional parameter "num_shards" is set, the database is sharded into multiple shard files.  Each file has a suffix like "-00003-of-00015".  If the value is 0, the number of shards is set by patterns of the existing files, or 1 if they doesn't exist.  On a sharded database, get_multi, set_multi, and remove_multi split the keys by shard and process the shards in parallel on native worker threads.
+    # If the optional parameter "latency_stats" is true, the latencies of operations are recorded in histograms.  See the stats method for details.
+    # The optional parameter "read_cache" enables an LRU cache of records in front of the database.  Its value is a hash of "capacity" for the maximum number of cached records and "max_value_size" for the maximum size of cached values, which is 4096 by default.  Values read by "get", "[]", and "get_multi" are cached, "include?" uses the cached records without adding one, and every update through the same DBM object or its iterators invalidates the record.  Updates through other DBM objects or other processes are not seen by the cache, so it should be used only when all updates go through the same object.  AsyncDBM can't be made for a database with the cache.  Cache hits don't release the GVL and aren't counted in the latency statistics.
+    # The optional parameter "bloom_filter" enables a Bloom filter of the keys, which answers lookups of missing keys by "get", "[]", "get_multi", and "include?" without accessing the database.  Its value is true or a hash of "capacity" for the expected number of records and "error_rate" for the false positive rate, which is 0.01 by default.  The filter is built by scanning all records when the database is opened.  Keys stored through the same DBM object are added to the filter, but keys of removed records remain in it until the database is reopened, and the false positive rate grows if the number of records exceeds the capacity.  As with "read_cache", it should be used only when all updates go through the same object, and AsyncDBM can't be made for a database with the filter.  The key generated by "push_last" is added to the filter when the method returns, so other threads can miss the record until then.
+    # The optional parameter "intern_values" specifies the maximum size of values which are returned as frozen and deduplicated strings by "get", "[]", "get_multi", "each", "parallel_each", and methods of iterators.  Repeatedly returned small values like enumerations then share one string object instead of allocating a new one each time, which reduces GC load.  It is 0 by default, which disables the feature.  Keys and values yielded to the blocks of "process" are not affected.
+    # If the optional parameter "reopen_on_fork" is true, the database is reopened as read-only in the child process automatically by the hook of Process._fork, which is available on Ruby 3.1 or later.  Databases opened as writable are not reopened.  See the after_fork method for details.
     def open(path, writable, **params)
       # (native code)
     end
@@ -655,6 +660,13 @@ module Tkrzw
       # (native code)
     end
 
+    # Gets typed metrics of the database.
+    # @return A hash of metric names and their values.
+    # The same properties as the "inspect_details" method are included, but numeric values are Integer or Float objects and "true" and "false" are boolean objects.  "num_records" and "file_size" are always included.  "fragmentation" is the ratio of the space not used by the effective data to the file size, which is included if the database reports "eff_data_size".  "read_cache_hits" and "read_cache_misses" are included if the read cache is enabled, and "bloom_filter_lookups" and "bloom_filter_negatives" are included if the Bloom filter is enabled.  All values are collected in one native call.
+    def metrics()
+      # (native code)
+    end
+
     # Checks whether the database is open.
     # @return True if the database is open, or false if not.
     def open?()
@@ -751,6 +763,58 @@ module Tkrzw
     def each(&block)
       # (native code)
     end
+
+    # Gets statistics of operations.
+    # @return A hash of statistics.
+    # The hash has "gvl" for the statistics of native calls without the GVL in the concurrent mode.  It is a hash which has "calls" for the number of calls, "native_time" for the total time in native code, "wait_time" for the total time to reacquire the GVL after native code, and "max_wait_time" for the maximum of the latter, all in seconds.  A large wait time means that threads are queueing to get the GVL back and the concurrent mode is not beneficial.  Iterators of the database share the statistics.
+    # If the database is opened with the "read_cache" parameter, the hash also has "read_cache", which is a hash of "hits", "misses", "count" for the number of cached records, and "capacity".
+    # If the database is opened with the "bloom_filter" parameter, the hash also has "bloom_filter", which is a hash of "capacity", "error_rate", "num_bits", "num_hashes", "lookups" for the number of checked keys, and "negatives" for the number of keys answered as missing.
+    # If the database is opened with the "latency_stats" parameter, the hash also has operation names "get", "set", "remove", "process", "iterate", "synchronize", and "rebuild".  Each of them is a hash of statistics which has "count" for the number of calls, "mean", "p50", "p90", "p99", "p999", and "max" for the latencies in microseconds.  Latencies are measured natively around the native calls, so they don't include the time of converting Ruby objects.  The percentiles are precise within about 6%.
+    def stats()
+      # (native code)
+    end
+
+    # Resets the statistics of operations.
+    def reset_stats()
+      # (native code)
+    end
+
+    # Starts or stops recording a trace of operations.
+    # @param path The path of the trace file.  If it is nil, recording is stopped.
+    # @return The result status.
+    # Each line of the trace file is a TSV record of the elapsed time in microseconds, the index of the native thread numbered from zero in the order of the first operation of each thread in the process, the method name, the URL-encoded key, and the value size.  The value size is -1 if the value is not known, as with misses of "get" and with "remove".  Multi-key methods record a line for each key.  "rekey" records the old key and then "rekey_to" with the new key.  Methods of iterators are recorded with the "iterator_" prefix, and scanning methods and "clear" are recorded with an empty key.  Operations of AsyncDBM are not recorded, because they run later on the threads of the task queue, where the order and the timing differ from those of the calls.  The trace is flushed when recording is stopped or the database is closed.  The "replay.rb" command drives a database with a recorded trace.
+    def record_trace(path)
+      # (native code)
+    end
+
+    # Attaches an index which is updated along with records of the database.
+    # @param index An Index object, whose keys are fields of the values and whose values are keys of the database.
+    # @param extractor A hash of the specification to extract the field from a value.  "prefix" is the prefix which the value must begin with, and which is stripped.  "delimiter" and "column" specify a column of the value split by the delimiter, counted from zero.  "offset" and "size" specify a byte range of the value or the column, where the size -1 means the rest.  Values without the field are not indexed.
+    # "set", "set_multi", "append", "remove", "remove_multi", "[]=", "delete", and "process" update the index in the same call of Process as the record, so the index is consistent with the database even with concurrent writers.  Other updating methods of the database and its iterators, including "process_each" with writable true, raise an error while an index is attached, and an AsyncDBM can't be made.  Existing records are not indexed by this method.
+    def attach_index(index, extractor)
+      # (native code)
+    end
+
+    # Detaches the index attached by the attach_index method.
+    # Method calls already in progress, including one running the block calling this, still update the index.
+    def detach_index()
+      # (native code)
+    end
+
+    # Reopens the database as read-only in the child process after fork.
+    # @return The result status.
+    # This should be called only in the child process.  The handle inherited from the parent process is discarded without being closed, because closing it would affect the files which the parent process still uses.  As the same files are opened again, the memory-mapped regions are served from the page cache warmed by the parent process.  If the parent process opened the database as writable, PRECONDITION_ERROR is returned and the inherited handle is kept, because the file lock held by the parent process can't be taken and the files must not be updated by two processes.  On-memory databases are not reopened, even if they were opened with a path, so that the child process keeps the records which are not synchronized to the file yet.
+    def after_fork()
+      # (native code)
+    end
+
+    # Scans all records on native threads, in parallel if possible.
+    # @param params Optional parameters.
+    # @return The result status if a block is given.  Otherwise, a pair of the result status and a hash of aggregated values: "count", "key_size", "value_size", and "value_sum".
+    # If a block is given, it is called with an array of key-value pairs for each batch of records.  The block must not update the database.  The batches come through a bounded queue from the native threads, so scanning overlaps with the block.  If the database is sharded and opened as read-only, each shard file is scanned by a separate thread.  Otherwise, one thread scans the whole database, and requesting more than one thread is reported as INFEASIBLE_ERROR without scanning.  Without a block, the aggregation is done natively and "value_sum" is the sum of the values as decimal numbers.  The optional parameters "threads" for the number of threads and "batch_size" for the number of records in each batch are supported.  If a native thread cannot be started, SYSTEM_ERROR is returned.
+    def parallel_each(**params)
+      # (native code)
+    end
   end
 
   # Iterator for each record.
@@ -1119,6 +1183,7 @@ module Tkrzw
 
     # Closes the file.
     # @return The result status.
+    # PRECONDITION_ERROR is returned while an AsyncFile is attached to the file.
     def close()
       # (native code)
     end
@@ -1131,6 +1196,26 @@ module Tkrzw
     def read(off, size, status=nil)
       # (native code)
     end
+
+    # Reads data into a buffer given by the caller, without allocating a new string.
+    # @param off The offset of a source region.
+    # @param size The size to be read.
+    # @param buffer A String or an IO::Buffer object to store the data.  A string is resized to the size.  An IO::Buffer must be as large as the size.
+    # @return The result status.
+    # The content of the buffer is undefined on failure.  IO::Buffer is supported on Ruby 3.2 or later.
+    def read_into(off, size, buffer)
+      # (native code)
+    end
+
+    # Reads data into a new IO::Buffer object.
+    # @param off The offset of a source region.
+    # @param size The size to be read.
+    # @param status A status object to which the result status is assigned.  It can be omitted.
+    # @return The IO::Buffer object of the read data or nil on failure.
+    # The data is copied into memory owned by the buffer even for memory-mapped files, because the mapped region can be remapped or unmapped while the buffer is alive.  This method is supported on Ruby 3.2 or later.
+    def pread_buffer(off, size, status=nil)
+      # (native code)
+    end
       
     # Writes data.
     # @param off The offset of the destination region.
@@ -1140,6 +1225,23 @@ module Tkrzw
       # (native code)
     end
 
+    # Reads data of multiple regions in one native call.
+    # @param ranges An array of pairs of the offset and the size of each region.
+    # @param status A status object to which the first failure status is assigned.  It can be omitted.
+    # @return An array of the read data of the regions in the same order.  The element of a region which fails to be read is nil.
+    # This is faster than calling "read" for each region as the GVL is released only once.
+    def read_multi(ranges, status=nil)
+      # (native code)
+    end
+
+    # Writes data of multiple regions in one native call.
+    # @param records An array of pairs of the offset and the data to write.
+    # @return The result status.
+    # The regions are written in order and the operation stops at the first failure.
+    def write_multi(records)
+      # (native code)
+    end
+
     # Appends data at the end of the file.
     # @param data The data to write.
     # @param status A status object to which the result status is assigned.  It can be omitted.
@@ -1182,8 +1284,18 @@ module Tkrzw
     # @param mode The search mode.  "contain" extracts lines containing the pattern.  "begin" extracts lines beginning with the pattern.  "end" extracts lines ending with the pattern.  "regex" extracts lines partially matches the pattern of a regular expression.  "edit" extracts lines whose edit distance to the UTF-8 pattern is the least.  "editbin" extracts lines whose edit distance to the binary pattern is the least.
     # @param pattern The pattern for matching.
     # @param capacity The maximum records to obtain.  0 means unlimited.
-    # @return A list of lines matching the condition.
-    def search(mode, pattern, capacity=0)
+    # @param params Optional parameters for the parallel search with a block.
+    # @return A list of lines matching the condition, or the result status if a block is given.
+    # If a block is given, the file is split into chunks on line boundaries, which are searched by native threads in parallel, and the block is called with an array of pairs of a matching line and its offset for each batch of matches.  Batches come in no particular order.  Only the modes "contain", "begin", "end", and "regex" are supported.  The optional parameters "threads" for the number of threads, which is the number of CPU cores by default, "batch_size" for the number of lines in each batch, and "chunk_size" for the size of each chunk, which is 16MB by default, are supported.  If a native thread cannot be started, SYSTEM_ERROR is returned without calling the block.
+    def search(mode, pattern, capacity=0, **params)
+      # (native code)
+    end
+
+    # Reads lines of the file natively and yields them in batches.
+    # @param params Optional parameters.
+    # @return The result status.
+    # The block is called with an array of lines without the line feed and the offset just after the last line of the batch.  The offset can be given as "start_offset" later to resume reading from the next line.  The optional parameters "start_offset" for the offset to start at, "batch_size" for the number of lines in each batch, which is 1000 by default, and "chunk_size" for the size of each read, which is 1MB by default, are supported.  The last line is yielded even without a line feed.  Lines appended to the file during the iteration are also read.
+    def each_line(**params)
       # (native code)
     end
 
@@ -1198,6 +1310,79 @@ module Tkrzw
     def inspect()
       # (native code)
     end
+
+    # Gets statistics of operations.
+    # @return A hash of statistics.
+    # The hash has "gvl" for the statistics of native calls without the GVL, in the same format as the "stats" method of DBM.
+    def stats()
+      # (native code)
+    end
+
+    # Resets the statistics of operations.
+    def reset_stats()
+      # (native code)
+    end
+  end
+
+  # Asynchronous file adapter.
+  # This class is a wrapper of File for asynchronous operations.  A task queue with a thread pool is used inside.  Every method except for the constructor and the destructor is run by a thread in the thread pool and the result is set in the future oject of the return value.  Tasks run concurrently if there are multiple threads, so the order of writes to overlapping regions is not guaranteed.  The destruct method waits for all tasks to be done.  The file can't be closed until the destruct method is called, and destructing the file object doesn't close the file while it is in use by the tasks.  If an AsyncFile object is collected as garbage without being destructed, its remaining tasks are done by a background thread.
+  class AsyncFile
+    # Sets up the task queue.
+    # @param file A file object which has been opened.
+    # @param num_worker_threads: The number of threads in the internal thread pool.
+    def initialize(file, num_worker_threads)
+      # (native code)
+    end
+
+    # Returns a string representation of the content.
+    # @return The string representation of the content.
+    def to_s()
+      # (native code)
+    end
+
+    # Returns a string representation of the object.
+    # @return The string representation of the object.
+    def inspect()
+      # (native code)
+    end
+
+    # Destructs the asynchronous file adapter.
+    # This method waits for all tasks to be done.
+    def destruct()
+      # (native code)
+    end
+
+    # Reads data.
+    # @param off The offset of a source region.
+    # @param size The size to be read.
+    # @return The future for the result status and the read data.
+    def read(off, size)
+      # (native code)
+    end
+
+    # Writes data.
+    # @param off The offset of the destination region.
+    # @param data The data to write.
+    # @return The future for the result status.
+    def write(off, data)
+      # (native code)
+    end
+
+    # Appends data at the end of the file.
+    # @param data The data to write.
+    # @return The future for the result status and the offset at which the data has been put.
+    def append(data)
+      # (native code)
+    end
+
+    # Synchronizes the content of the file to the file system.
+    # @param hard True to do physical synchronization with the hardware or false to do only logical synchronization with the file system.
+    # @param off The offset of the region to be synchronized.
+    # @param size The size of the region to be synchronized.  If it is zero, the length to the end of file is specified.
+    # @return The future for the result status.
+    def synchronize(hard, off=0, size=0)
+      # (native code)
+    end
   end
 
   # Secondary index interface.
@@ -1245,6 +1430,43 @@ module Tkrzw
       # (native code)
     end
 
+    # Gets all values of records of multiple keys in one native call.
+    # @param keys An array of the keys to look for.
+    # @param max The maximum number of values to get for each key.  0 means unlimited.
+    # @return A hash of each key and the array of its values.  A key which doesn't match any record has an empty array.
+    # The keys are looked up in sorted order, which improves the locality of access to file-based indexes.
+    def get_values_multi(keys, max=0)
+      # (native code)
+    end
+
+    # Gets the values which all of the keys have.
+    # @param keys An array of the keys to look for.
+    # @param max The maximum number of values to get.  0 means unlimited.
+    # @return A list of the common values in ascending order.
+    # The cursors of the keys jump over values which can't be common, so the values of frequent keys are not read entirely if any key is selective.
+    def intersect(keys, max=0)
+      # (native code)
+    end
+
+    # Gets the values which any of the keys has.
+    # @param keys An array of the keys to look for.
+    # @param max The maximum number of values to get.  0 means unlimited.
+    # @return A list of the values without duplication in the lexical order.
+    # The values of the keys are merged natively, which assumes that the values of each key are in the lexical order as in indexes with the default key comparator.
+    def union(keys, max=0)
+      # (native code)
+    end
+
+    # Calls the given block with batches of the values of a key in a range.
+    # @param key The key to look for.
+    # @param from_value The value to start with, inclusive.  nil means the first value.
+    # @param to_value The value to end with, exclusive.  nil means no upper bound.
+    # @param batch_size The maximum number of values passed to the block at once.
+    # Each batch is read by one native call, which assumes that the values of the key are in the lexical order as in indexes with the default key comparator.
+    def each_range(key, from_value=nil, to_value=nil, batch_size=1000, &block)
+      # (native code)
+    end
+
     # Adds a record.
     # @param key The key of the record.  This can be an arbitrary expression to search the index.
     # @param value The value of the record.  This should be a primary value of another database.
@@ -1261,6 +1483,21 @@ module Tkrzw
       # (native code)
     end
 
+    # Adds multiple records in one native call.
+    # @param records An array of pairs of the key and the value of each record.
+    # @return The result status, which is the first failure if any.
+    # The records are sorted natively and added in the order of the keys, which is efficient for bulk loading into the tree database inside.
+    def add_multi(records)
+      # (native code)
+    end
+
+    # Removes multiple records in one native call.
+    # @param records An array of pairs of the key and the value of each record.
+    # @return The result status, which is the first failure if any.  All other records are removed even if some records don't exist.
+    def remove_multi(records)
+      # (native code)
+    end
+
     # Gets the number of records.
     # @return The number of records, or 0 on failure.
     def count()
@@ -1333,6 +1570,18 @@ module Tkrzw
     def each(&block)
       # (native code)
     end
+
+    # Gets statistics of operations.
+    # @return A hash of statistics.
+    # The hash has "gvl" for the statistics of native calls without the GVL, in the same format as the "stats" method of DBM.  Iterators of the index share the statistics.
+    def stats()
+      # (native code)
+    end
+
+    # Resets the statistics of operations.
+    def reset_stats()
+      # (native code)
+    end
   end
 
   # Iterator for each record of the secondary index.
@@ -1382,6 +1631,81 @@ module Tkrzw
       # (native code)
     end
 
+    # Gets the keys and the values of the current record and the following records, and moves the iterator past them.
+    # @param num The maximum number of records to get.
+    # @return A list of tuples of the key and the value.  At the end, the list is empty.
+    def get_batch(num)
+      # (native code)
+    end
+
+    # Returns a string representation of the content.
+    # @return The string representation of the content.
+    def to_s()
+      # (native code)
+    end
+
+    # Returns a string representation of the object.
+    # @return The string representation of the object.
+    def inspect()
+      # (native code)
+    end
+  end
+
+  # Pool of database handles on the same file.
+  # A pool has multiple read-only handles, which are DBM objects, on the same file.  Threads check out a reader, use it, and check it in.  Checking out and checking in are done in constant time without locks.  As each reader has its own internal locks and caches, threads using different readers don't contend with each other.  As the caches are not shared, the file must not be updated while the pool is open.  Thus, the pool is suitable for data which are built beforehand and only read while serving.  Every opened pool must be closed explicitly by the "close" method.
+  class Pool
+    # Initializes the pool.
+    def initialize()
+      # (native code)
+    end
+
+    # Opens read-only database handles on a file.
+    # @param path A path of the file.
+    # @param writable This must be false, as the pool is read-only.  Otherwise, INVALID_ARGUMENT_ERROR is returned.
+    # @param params Optional parameters.  They are passed to the "open" method of DBM.
+    # @return The result status.
+    # The optional parameter "num_readers" specifies the number of readers, which is 1 by default.  Each reader has its own metadata and page cache, which are not updated by writes of other handles.  Thus, the file must not be updated while the pool is open.
+    def open(path, writable, **params)
+      # (native code)
+    end
+
+    # Closes all database handles.
+    # @return The result status.  If any reader is checked out, PRECONDITION_ERROR is returned and nothing is closed.
+    def close()
+      # (native code)
+    end
+
+    # Checks out a reader.
+    # @return A read-only DBM object or nil if all readers are in use.
+    def checkout()
+      # (native code)
+    end
+
+    # Checks in a reader.
+    # @param dbm The DBM object which was checked out.
+    def checkin(dbm)
+      # (native code)
+    end
+
+    # Calls the given block with a reader, which is checked in after the block.
+    # @return The return value of the block.
+    # If all readers are in use, this waits for one of them to be checked in, without holding the GVL.
+    def with_reader(&block)
+      # (native code)
+    end
+
+    # Gets the number of readers.
+    # @return The number of readers.
+    def num_readers()
+      # (native code)
+    end
+
+    # Gets the number of readers which are not checked out.
+    # @return The number of available readers.
+    def num_available()
+      # (native code)
+    end
+
     # Returns a string representation of the content.
     # @return The string representation of the content.
     def to_s()
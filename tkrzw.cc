@@ -11,16 +11,32 @@
  * and limitations under the License.
  *************************************************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <regex>
+#include <set>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <map>
 #include <memory>
 #include <utility>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "tkrzw_cmd_util.h"
 #include "tkrzw_dbm.h"
@@ -34,12 +50,24 @@
 #include "tkrzw_key_comparators.h"
 #include "tkrzw_lib_common.h"
 #include "tkrzw_str_util.h"
+#include "tkrzw_thread_util.h"
+
+#include <unistd.h>
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+#endif
 
 extern "C" {
 
 #include "ruby.h"
+#include "ruby/encoding.h"
 #include "ruby/thread.h"
 
+#if defined(HAVE_RB_IO_BUFFER_GET_BYTES_FOR_WRITING)
+#include "ruby/io/buffer.h"
+#endif
+
 typedef VALUE (*METHOD)(...);
 
 // Global variables.
@@ -49,6 +77,7 @@ ID id_obj_to_s;
 ID id_obj_to_i;
 ID id_obj_to_f;
 ID id_str_force_encoding;
+ID id_str_uminus;
 
 volatile VALUE cls_util;
 volatile VALUE cls_status;
@@ -59,9 +88,13 @@ volatile VALUE cls_dbm;
 volatile VALUE cls_iter;
 volatile VALUE cls_asyncdbm;
 volatile VALUE cls_file;
+volatile VALUE cls_asyncfile;
 volatile VALUE cls_index;
 volatile VALUE cls_indexiter;
+volatile VALUE cls_pool;
+ID id_pool_readers;
 volatile VALUE obj_dbm_any_data;
+volatile VALUE mod_fork_hook;
 
 // Generates a string expression of an arbitrary object.
 static VALUE StringValueEx(VALUE vobj) {
@@ -181,6 +214,18 @@ static std::map<std::string, std::string> HashToMap(VALUE vhash) {
   return map;
 }
 
+// Gets a map of string parameters from a nested hash of parameters.
+static std::map<std::string, std::string> GetNestedParams(VALUE vparams, const char* name) {
+  if (TYPE(vparams) != T_HASH) {
+    return std::map<std::string, std::string>();
+  }
+  volatile VALUE vnested = rb_hash_aref(vparams, ID2SYM(rb_intern(name)));
+  if (vnested == Qnil) {
+    vnested = rb_hash_aref(vparams, rb_str_new2(name));
+  }
+  return HashToMap(vnested);
+}
+
 // Extracts a list of pairs of string views from an array object.
 static std::vector<std::pair<std::string_view, std::string_view>> ExtractSVPairs(VALUE varray) {
   std::vector<std::pair<std::string_view, std::string_view>> result;
@@ -221,6 +266,7 @@ static void DefineModule() {
   id_obj_to_i = rb_intern("to_i");
   id_obj_to_f = rb_intern("to_f");
   id_str_force_encoding = rb_intern("force_encoding");
+  id_str_uminus = rb_intern("-@");
 }
 
 // Makes a string object in the internal encoding of the database.
@@ -232,27 +278,555 @@ static VALUE MakeString(std::string_view str, VALUE venc) {
   return vstr;
 }
 
+// Makes a string object of a value, which is frozen and deduplicated if interning is enabled
+// and the value is not larger than the maximum size.
+static VALUE MakeValueString(std::string_view str, VALUE venc, int64_t max_interned_size) {
+  if (max_interned_size <= 0 || static_cast<int64_t>(str.size()) > max_interned_size) {
+    return MakeString(str, venc);
+  }
+#if defined(HAVE_RB_ENC_INTERNED_STR)
+  return rb_enc_interned_str(str.data(), str.size(),
+                             venc == Qnil ? rb_ascii8bit_encoding() : rb_to_encoding(venc));
+#else
+  return rb_funcall(MakeString(str, venc), id_str_uminus, 0);
+#endif
+}
+
+// Gets the current time of the steady clock in nanoseconds.
+static int64_t GetSteadyNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Histogram of latencies with log-linear buckets, in the manner of HdrHistogram.
+class LatencyHistogram final {
+ public:
+  static constexpr int32_t SUB_BITS = 4;
+  static constexpr int32_t NUM_SUBS = 1 << SUB_BITS;
+  static constexpr int32_t NUM_BUCKETS = (64 - SUB_BITS + 1) * NUM_SUBS;
+
+  LatencyHistogram() {
+    Reset();
+  }
+
+  void Add(int64_t nsec) {
+    nsec = std::max<int64_t>(nsec, 0);
+    buckets_[GetBucketIndex(nsec)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(nsec, std::memory_order_relaxed);
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (nsec > max && !max_.compare_exchange_weak(max, nsec, std::memory_order_relaxed)) {
+    }
+  }
+
+  void Reset() {
+    for (auto& bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    total_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  int64_t GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  int64_t GetTotal() const {
+    return total_.load(std::memory_order_relaxed);
+  }
+
+  int64_t GetMax() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+  int64_t GetPercentile(double ratio) const {
+    const int64_t count = GetCount();
+    if (count < 1) {
+      return 0;
+    }
+    const int64_t rank = std::max<int64_t>(std::ceil(count * ratio), 1);
+    int64_t sum = 0;
+    for (int32_t i = 0; i < NUM_BUCKETS; i++) {
+      sum += buckets_[i].load(std::memory_order_relaxed);
+      if (sum >= rank) {
+        return std::min(GetBucketUpperBound(i), GetMax());
+      }
+    }
+    return GetMax();
+  }
+
+ private:
+  static int32_t GetBucketIndex(uint64_t value) {
+    if (value < (uint64_t)NUM_SUBS) {
+      return value;
+    }
+    const int32_t shift = 63 - __builtin_clzll(value) - SUB_BITS;
+    return (shift + 1) * NUM_SUBS + ((value >> shift) & (NUM_SUBS - 1));
+  }
+
+  static int64_t GetBucketUpperBound(int32_t index) {
+    if (index < NUM_SUBS) {
+      return index;
+    }
+    const int32_t shift = index / NUM_SUBS - 1;
+    const uint64_t base = NUM_SUBS + index % NUM_SUBS + 1;
+    return std::min<uint64_t>((base << shift) - 1, tkrzw::INT64MAX);
+  }
+
+  std::atomic_int64_t buckets_[NUM_BUCKETS];
+  std::atomic_int64_t count_;
+  std::atomic_int64_t total_;
+  std::atomic_int64_t max_;
+};
+
+// Statistics of native calls without the GVL.
+struct GVLStats {
+  std::atomic_int64_t num_calls{0};
+  std::atomic_int64_t native_time{0};
+  std::atomic_int64_t wait_time{0};
+  std::atomic_int64_t max_wait_time{0};
+};
+
 // Wrapper of a native function.
 class NativeFunction {
  public:
-  NativeFunction(bool concurrent, std::function<void(void)> func)
-      : func_(std::move(func)) {
+  NativeFunction(bool concurrent, std::function<void(void)> func,
+                 GVLStats* gvl_stats = nullptr, LatencyHistogram* hist = nullptr)
+      : func_(std::move(func)), hist_(hist) {
     if (concurrent) {
+      timed_ = gvl_stats != nullptr || hist != nullptr;
       rb_thread_call_without_gvl(Run, this, RUBY_UBF_IO, nullptr);
+      if (gvl_stats != nullptr) {
+        const int64_t wait_time = GetSteadyNanoseconds() - end_time_;
+        gvl_stats->num_calls.fetch_add(1, std::memory_order_relaxed);
+        gvl_stats->native_time.fetch_add(end_time_ - start_time_, std::memory_order_relaxed);
+        gvl_stats->wait_time.fetch_add(wait_time, std::memory_order_relaxed);
+        int64_t max_wait_time = gvl_stats->max_wait_time.load(std::memory_order_relaxed);
+        while (wait_time > max_wait_time &&
+               !gvl_stats->max_wait_time.compare_exchange_weak(
+                   max_wait_time, wait_time, std::memory_order_relaxed)) {
+        }
+      }
     } else {
-      func_();
+      timed_ = hist != nullptr;
+      Run(this);
     }
   }
 
   static void* Run(void* param) {
-    ((NativeFunction*)param)->func_();
+    NativeFunction* self = (NativeFunction*)param;
+    if (!self->timed_) {
+      self->func_();
+      return nullptr;
+    }
+    self->start_time_ = GetSteadyNanoseconds();
+    self->func_();
+    self->end_time_ = GetSteadyNanoseconds();
+    if (self->hist_ != nullptr) {
+      self->hist_->Add(self->end_time_ - self->start_time_);
+    }
     return nullptr;
   }
 
  private:
   std::function<void(void)> func_;
+  LatencyHistogram* hist_;
+  bool timed_ = false;
+  int64_t start_time_ = 0;
+  int64_t end_time_ = 0;
+};
+
+// Static tracepoints at entry and exit of a binding method.
+// With sys/sdt.h, USDT probes "tkrzw_ruby:entry(method)" and
+// "tkrzw_ruby:exit(method, key_size, value_size, status_code)" are emitted.  Otherwise, this
+// does nothing.  The status code is -1 if the method doesn't return a status.
+class ProbeScope final {
+ public:
+  explicit ProbeScope(const char* method) : method_(method) {
+#if defined(HAVE_SYS_SDT_H)
+    DTRACE_PROBE1(tkrzw_ruby, entry, method_);
+#endif
+  }
+
+  ~ProbeScope() {
+#if defined(HAVE_SYS_SDT_H)
+    DTRACE_PROBE4(tkrzw_ruby, exit, method_, key_size_, value_size_, status_code_);
+#endif
+  }
+
+  void SetKeySize(int64_t size) {
+    key_size_ = size;
+  }
+
+  void SetValueSize(int64_t size) {
+    value_size_ = size;
+  }
+
+  void SetStatus(const tkrzw::Status& status) {
+    status_code_ = status.GetCode();
+  }
+
+ private:
+  const char* method_;
+  int64_t key_size_ = 0;
+  int64_t value_size_ = 0;
+  int32_t status_code_ = -1;
+};
+
+// Kinds of operations whose latencies are recorded.
+enum LatencyOperation : int32_t {
+  OP_GET = 0,
+  OP_SET,
+  OP_REMOVE,
+  OP_PROCESS,
+  OP_ITERATE,
+  OP_SYNCHRONIZE,
+  OP_REBUILD,
+  NUM_LATENCY_OPS,
+};
+
+// Names of the operations whose latencies are recorded.
+static const char* const LATENCY_OP_NAMES[NUM_LATENCY_OPS] = {
+  "get", "set", "remove", "process", "iterate", "synchronize", "rebuild",
 };
 
+// Latency histograms of the operations of a database.
+struct LatencyStats {
+  LatencyHistogram hists[NUM_LATENCY_OPS];
+};
+
+// Gets the histogram of an operation, or nullptr if the latencies are not recorded.
+static LatencyHistogram* GetLatencyHistogram(LatencyStats* stats, int32_t op) {
+  return stats == nullptr ? nullptr : &stats->hists[op];
+}
+
+// Records the latency of the current scope.
+class LatencyTimer final {
+ public:
+  explicit LatencyTimer(LatencyHistogram* hist)
+      : hist_(hist), start_time_(hist == nullptr ? 0 : GetSteadyNanoseconds()) {}
+
+  ~LatencyTimer() {
+    if (hist_ != nullptr) {
+      hist_->Add(GetSteadyNanoseconds() - start_time_);
+    }
+  }
+
+ private:
+  LatencyHistogram* hist_;
+  int64_t start_time_;
+};
+
+// LRU cache of records read from a database, striped into shards with separate locks.
+class ReadCache final {
+ public:
+  // The maximum number of shards.
+  static constexpr int32_t MAX_SHARDS = 16;
+  // Estimated memory overhead of each cached record.
+  static constexpr int64_t RECORD_OVERHEAD = 96;
+
+  ReadCache(int64_t capacity, int64_t max_value_size)
+      : num_shards_(std::max<int64_t>(std::min<int64_t>(capacity, MAX_SHARDS), 1)),
+        shard_capacity_(std::max<int64_t>(capacity / num_shards_, 1)),
+        max_value_size_(max_value_size), shards_(num_shards_) {}
+
+  // Gets the value of a cached record.
+  bool Get(std::string_view key, std::string* value) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      num_misses_.fetch_add(1);
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    *value = it->second->second;
+    num_hits_.fetch_add(1);
+    return true;
+  }
+
+  // Gets the invalidation epoch of the shard of a key, to be passed to Add.
+  uint64_t GetEpoch(std::string_view key) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.epoch;
+  }
+
+  // Adds a record unless the shard has been invalidated after the epoch was taken.
+  void Add(std::string_view key, std::string_view value, uint64_t epoch) {
+    if (static_cast<int64_t>(value.size()) > max_value_size_) {
+      return;
+    }
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.epoch != epoch || shard.index.find(key) != shard.index.end()) {
+      return;
+    }
+    shard.lru.emplace_front(std::string(key), std::string(value));
+    const auto& rec = shard.lru.front();
+    shard.index.emplace(std::string_view(rec.first), shard.lru.begin());
+    memory_size_.fetch_add(rec.first.size() + rec.second.size() + RECORD_OVERHEAD);
+    if (static_cast<int64_t>(shard.lru.size()) > shard_capacity_) {
+      EraseRecord(&shard, std::prev(shard.lru.end()));
+    }
+  }
+
+  // Removes a record of a key which has been modified.
+  void Invalidate(std::string_view key) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.epoch++;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      EraseRecord(&shard, it->second);
+    }
+  }
+
+  // Removes all records.
+  void Clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.epoch++;
+      shard.index.clear();
+      shard.lru.clear();
+    }
+    memory_size_.store(0);
+  }
+
+  int64_t GetNumHits() const {
+    return num_hits_.load();
+  }
+
+  int64_t GetNumMisses() const {
+    return num_misses_.load();
+  }
+
+  int64_t GetMemorySize() const {
+    return memory_size_.load();
+  }
+
+  int64_t GetCount() {
+    int64_t count = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      count += shard.lru.size();
+    }
+    return count;
+  }
+
+  int64_t GetCapacity() const {
+    return shard_capacity_ * num_shards_;
+  }
+
+  void ResetCounters() {
+    num_hits_.store(0);
+    num_misses_.store(0);
+  }
+
+ private:
+  typedef std::list<std::pair<std::string, std::string>> RecordList;
+
+  struct Shard {
+    std::mutex mutex;
+    RecordList lru;
+    std::unordered_map<std::string_view, RecordList::iterator> index;
+    uint64_t epoch = 0;
+  };
+
+  Shard& GetShard(std::string_view key) {
+    return shards_[std::hash<std::string_view>()(key) % num_shards_];
+  }
+
+  void EraseRecord(Shard* shard, RecordList::iterator it) {
+    memory_size_.fetch_sub(it->first.size() + it->second.size() + RECORD_OVERHEAD);
+    shard->index.erase(std::string_view(it->first));
+    shard->lru.erase(it);
+  }
+
+  const int64_t num_shards_;
+  const int64_t shard_capacity_;
+  const int64_t max_value_size_;
+  std::vector<Shard> shards_;
+  std::atomic_int64_t num_hits_{0};
+  std::atomic_int64_t num_misses_{0};
+  std::atomic_int64_t memory_size_{0};
+};
+
+// Bloom filter of the keys of a database, to answer lookups of missing keys natively.
+class BloomFilter final {
+ public:
+  BloomFilter(int64_t capacity, double error_rate) {
+    capacity = std::max<int64_t>(capacity, 1);
+    error_rate = std::min(std::max(error_rate, 1e-9), 0.5);
+    const double num_bits = -capacity * std::log(error_rate) / (std::log(2.0) * std::log(2.0));
+    num_words_ = std::max<int64_t>(static_cast<int64_t>(std::ceil(num_bits / 64)), 1);
+    num_hashes_ = std::max<int32_t>(
+        std::lround(num_words_ * 64.0 / capacity * std::log(2.0)), 1);
+    capacity_ = capacity;
+    error_rate_ = error_rate;
+    words_ = std::make_unique<std::atomic_uint64_t[]>(num_words_);
+    for (int64_t i = 0; i < num_words_; i++) {
+      words_[i].store(0);
+    }
+  }
+
+  // Adds a key.  This must be called before the record is stored in the database.
+  void Add(std::string_view key) {
+    uint64_t hash = 0, step = 0;
+    GetHashes(key, &hash, &step);
+    const uint64_t num_bits = num_words_ * 64;
+    for (int32_t i = 0; i < num_hashes_; i++) {
+      const uint64_t bit = hash % num_bits;
+      words_[bit / 64].fetch_or(1ULL << (bit % 64));
+      hash += step;
+    }
+  }
+
+  // Checks whether a key may exist.
+  bool MayContain(std::string_view key) {
+    num_lookups_.fetch_add(1);
+    uint64_t hash = 0, step = 0;
+    GetHashes(key, &hash, &step);
+    const uint64_t num_bits = num_words_ * 64;
+    for (int32_t i = 0; i < num_hashes_; i++) {
+      const uint64_t bit = hash % num_bits;
+      if (!(words_[bit / 64].load() & (1ULL << (bit % 64)))) {
+        num_negatives_.fetch_add(1);
+        return false;
+      }
+      hash += step;
+    }
+    return true;
+  }
+
+  int64_t GetCapacity() const {
+    return capacity_;
+  }
+
+  double GetErrorRate() const {
+    return error_rate_;
+  }
+
+  int64_t GetNumBits() const {
+    return num_words_ * 64;
+  }
+
+  int32_t GetNumHashes() const {
+    return num_hashes_;
+  }
+
+  int64_t GetNumLookups() const {
+    return num_lookups_.load();
+  }
+
+  int64_t GetNumNegatives() const {
+    return num_negatives_.load();
+  }
+
+  void ResetCounters() {
+    num_lookups_.store(0);
+    num_negatives_.store(0);
+  }
+
+ private:
+  static void GetHashes(std::string_view key, uint64_t* hash, uint64_t* step) {
+    uint64_t value = std::hash<std::string_view>()(key);
+    *hash = value;
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    *step = value | 1;
+  }
+
+  int64_t capacity_ = 0;
+  double error_rate_ = 0;
+  int64_t num_words_ = 0;
+  int32_t num_hashes_ = 0;
+  std::unique_ptr<std::atomic_uint64_t[]> words_;
+  std::atomic_int64_t num_lookups_{0};
+  std::atomic_int64_t num_negatives_{0};
+};
+
+// Recorder of the operations on a database as a TSV trace file.
+class TraceRecorder final {
+ public:
+  // The buffered data is written when it exceeds this size.
+  static constexpr size_t FLUSH_SIZE = 1 << 20;
+
+  TraceRecorder() : start_time_(GetSteadyNanoseconds()) {}
+
+  ~TraceRecorder() {
+    Close();
+  }
+
+  tkrzw::Status Open(const std::string& path) {
+    tkrzw::Status status = file_.Open(path, true, tkrzw::File::OPEN_TRUNCATE);
+    open_ = status == tkrzw::Status::SUCCESS;
+    return status;
+  }
+
+  tkrzw::Status Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_) {
+      return tkrzw::Status(tkrzw::Status::SUCCESS);
+    }
+    tkrzw::Status status = file_.Append(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    status |= file_.Close();
+    open_ = false;
+    return status;
+  }
+
+  // Records an operation of the current thread.
+  void Record(const char* method, std::string_view key, int64_t value_size) {
+    const int64_t elapsed = (GetSteadyNanoseconds() - start_time_) / 1000;
+    const int32_t thread_index = GetThreadIndex();
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_.append(tkrzw::StrCat(elapsed, "\t", thread_index, "\t", method, "\t",
+                                 tkrzw::StrEncodeURL(key), "\t", value_size, "\n"));
+    if (buffer_.size() >= FLUSH_SIZE) {
+      file_.Append(buffer_.data(), buffer_.size());
+      buffer_.clear();
+    }
+  }
+
+ private:
+  tkrzw::PolyFile file_;
+  bool open_ = false;
+  std::mutex mutex_;
+  std::string buffer_;
+  int64_t start_time_;
+
+  // Gets the index of the current native thread, which is numbered from zero on first use.
+  static int32_t GetThreadIndex() {
+    static std::atomic_int32_t next_index(0);
+    thread_local const int32_t index = next_index++;
+    return index;
+  }
+};
+
+// Makes a hash object of the statistics of native calls without the GVL.
+static VALUE MakeGVLStatsValue(const GVLStats& stats) {
+  volatile VALUE vstats = rb_hash_new();
+  rb_hash_aset(vstats, rb_str_new2("calls"), LL2NUM(stats.num_calls.load()));
+  rb_hash_aset(vstats, rb_str_new2("native_time"), DBL2NUM(stats.native_time.load() / 1e9));
+  rb_hash_aset(vstats, rb_str_new2("wait_time"), DBL2NUM(stats.wait_time.load() / 1e9));
+  rb_hash_aset(vstats, rb_str_new2("max_wait_time"),
+               DBL2NUM(stats.max_wait_time.load() / 1e9));
+  return vstats;
+}
+
+// Resets the statistics of native calls without the GVL.
+static void ResetGVLStats(GVLStats* stats) {
+  stats->num_calls.store(0);
+  stats->native_time.store(0);
+  stats->wait_time.store(0);
+  stats->max_wait_time.store(0);
+}
+
 // Yields the process to the given block.
 static VALUE YieldToBlock(VALUE args) {
   return rb_yield(args);
@@ -268,51 +842,836 @@ static VALUE GetEncoding(std::string_view name) {
 struct StructFuture {
   std::unique_ptr<tkrzw::StatusFuture> future;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+};
+
+// Extractor of a field of a value, to be the key of an index attached to a database.
+class IndexExtractor final {
+ public:
+  explicit IndexExtractor(const std::map<std::string, std::string>& params)
+      : prefix_(tkrzw::SearchMap(params, "prefix", "")),
+        delimiter_(tkrzw::SearchMap(params, "delimiter", "")),
+        column_(std::max<int64_t>(tkrzw::StrToInt(tkrzw::SearchMap(params, "column", "0")), 0)),
+        offset_(std::max<int64_t>(tkrzw::StrToInt(tkrzw::SearchMap(params, "offset", "0")), 0)),
+        size_(tkrzw::StrToInt(tkrzw::SearchMap(params, "size", "-1"))) {}
+
+  // Extracts the field.  False is returned if the value doesn't have it.
+  bool Extract(std::string_view value, std::string_view* field) const {
+    if (value.substr(0, prefix_.size()) != prefix_) {
+      return false;
+    }
+    value.remove_prefix(prefix_.size());
+    if (!delimiter_.empty()) {
+      for (int64_t i = 0; i < column_; i++) {
+        const size_t pos = value.find(delimiter_);
+        if (pos == std::string_view::npos) {
+          return false;
+        }
+        value.remove_prefix(pos + delimiter_.size());
+      }
+      value = value.substr(0, value.find(delimiter_));
+    }
+    if (offset_ > static_cast<int64_t>(value.size())) {
+      return false;
+    }
+    value.remove_prefix(offset_);
+    if (size_ >= 0) {
+      if (size_ > static_cast<int64_t>(value.size())) {
+        return false;
+      }
+      value = value.substr(0, size_);
+    }
+    *field = value;
+    return true;
+  }
+
+ private:
+  const std::string prefix_;
+  const std::string delimiter_;
+  const int64_t column_;
+  const int64_t offset_;
+  const int64_t size_;
 };
 
 // Ruby wrapper of the DBM object.
 struct StructDBM {
   std::unique_ptr<tkrzw::ParamDBM> dbm;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+  std::string open_path;
+  bool open_writable = false;
+  int32_t open_options = 0;
+  std::map<std::string, std::string> open_params;
+  int32_t num_shards = 0;
+  std::unique_ptr<tkrzw::TaskQueue> shard_queue;
+  pid_t shard_pid = 0;
+  int32_t pool_slot = -1;
+  std::shared_ptr<LatencyStats> latency_stats;
+  std::shared_ptr<GVLStats> gvl_stats = std::make_shared<GVLStats>();
+  std::unique_ptr<TraceRecorder> trace;
+  bool on_memory = false;
+  int64_t memory_size = 0;
+  int64_t num_updates = 0;
+  std::shared_ptr<ReadCache> read_cache;
+  std::unique_ptr<BloomFilter> bloom_filter;
+  int64_t max_interned_size = 0;
+  std::shared_ptr<IndexExtractor> index_extractor;
+  VALUE vindex = Qnil;
 };
 
+// Records an operation on a database if the trace is enabled.
+static void RecordTrace(StructDBM* sdbm, const char* method, std::string_view key,
+                        int64_t value_size) {
+  if (sdbm->trace != nullptr) {
+    sdbm->trace->Record(method, key, value_size);
+  }
+}
+
+// Removes a modified record from the read cache if it is enabled.
+static void InvalidateReadCache(StructDBM* sdbm, std::string_view key) {
+  if (sdbm->read_cache != nullptr) {
+    sdbm->read_cache->Invalidate(key);
+  }
+}
+
+// Removes all records from the read cache if it is enabled.
+static void ClearReadCache(StructDBM* sdbm) {
+  if (sdbm->read_cache != nullptr) {
+    sdbm->read_cache->Clear();
+  }
+}
+
+// Adds a key which is about to be stored to the Bloom filter if it is enabled.
+static void AddToBloomFilter(StructDBM* sdbm, std::string_view key) {
+  if (sdbm->bloom_filter != nullptr) {
+    sdbm->bloom_filter->Add(key);
+  }
+}
+
+// Checks whether a key may exist, by the Bloom filter if it is enabled.
+static bool MayContainKey(StructDBM* sdbm, std::string_view key) {
+  return sdbm->bloom_filter == nullptr || sdbm->bloom_filter->MayContain(key);
+}
+
+// Adds all keys of the database to a Bloom filter.
+static tkrzw::Status AddAllKeysToBloomFilter(StructDBM* sdbm, BloomFilter* filter) {
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sdbm->concurrent, [&]() {
+      auto iter = sdbm->dbm->MakeIterator();
+      status = iter->First();
+      std::string key;
+      while (status == tkrzw::Status::SUCCESS) {
+        status = iter->Get(&key);
+        if (status != tkrzw::Status::SUCCESS) {
+          break;
+        }
+        filter->Add(key);
+        status = iter->Next();
+      }
+      if (status == tkrzw::Status::NOT_FOUND_ERROR) {
+        status.Set(tkrzw::Status::SUCCESS);
+      }
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_ITERATE));
+  return status;
+}
+
+// Builds the Bloom filter of the keys of the database.
+static tkrzw::Status BuildBloomFilter(StructDBM* sdbm, int64_t capacity, double error_rate) {
+  const int64_t count = sdbm->dbm->CountSimple();
+  capacity = capacity > 0 ? std::max(capacity, count) : std::max<int64_t>(count * 2, 1 << 20);
+  auto filter = std::make_unique<BloomFilter>(capacity, error_rate);
+  const tkrzw::Status status = AddAllKeysToBloomFilter(sdbm, filter.get());
+  if (status == tkrzw::Status::SUCCESS) {
+    sdbm->bloom_filter = std::move(filter);
+  } else {
+    sdbm->bloom_filter.reset(nullptr);
+  }
+  return status;
+}
+
+// Gets the value of a record, via the read cache if it is enabled.
+static tkrzw::Status GetWithReadCache(StructDBM* sdbm, std::string_view key, std::string* value) {
+  ReadCache* cache = sdbm->read_cache.get();
+  if (cache != nullptr && cache->Get(key, value)) {
+    return tkrzw::Status(tkrzw::Status::SUCCESS);
+  }
+  const uint64_t epoch = cache == nullptr ? 0 : cache->GetEpoch(key);
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sdbm->concurrent, [&]() {
+      status = sdbm->dbm->Get(key, value);
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_GET));
+  if (cache != nullptr && status == tkrzw::Status::SUCCESS) {
+    cache->Add(key, *value, epoch);
+  }
+  return status;
+}
+
 // Ruby wrapper of the Iterator object.
 struct StructIter {
   std::unique_ptr<tkrzw::DBM::Iterator> iter;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+  VALUE vdbm = Qnil;
+  std::shared_ptr<LatencyStats> latency_stats;
+  std::shared_ptr<ReadCache> read_cache;
+  int64_t max_interned_size = 0;
+  std::shared_ptr<GVLStats> gvl_stats = std::make_shared<GVLStats>();
 };
 
 // Ruby wrapper of the AsyncDBM object.
 struct StructAsyncDBM {
   std::unique_ptr<tkrzw::AsyncDBM> async;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+  VALUE vdbm = Qnil;
 };
 
 // Ruby wrapper of the File object.
 struct StructFile {
-  std::unique_ptr<tkrzw::PolyFile> file;
+  // This is shared with AsyncFile objects and their tasks, which keep the file alive.
+  std::shared_ptr<tkrzw::PolyFile> file;
+  bool concurrent = false;
+  VALUE venc = Qnil;
+  std::shared_ptr<GVLStats> gvl_stats = std::make_shared<GVLStats>();
+};
+
+// Ruby wrapper of the AsyncFile object.
+struct StructAsyncFile {
+  std::unique_ptr<tkrzw::TaskQueue> queue;
+  std::shared_ptr<tkrzw::PolyFile> file;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+  VALUE vfile = Qnil;
 };
 
 // Ruby wrapper of the Index object.
 struct StructIndex {
   std::unique_ptr<tkrzw::PolyIndex> index;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+  std::shared_ptr<GVLStats> gvl_stats = std::make_shared<GVLStats>();
+  bool on_memory = false;
+  int64_t memory_size = 0;
+  int64_t num_updates = 0;
 };
 
 // Ruby wrapper of the IndexIterator object.
 struct StructIndexIter {
   std::unique_ptr<tkrzw::PolyIndex::Iterator> iter;
   bool concurrent = false;
-  volatile VALUE venc = Qnil;
+  VALUE venc = Qnil;
+  VALUE vindex = Qnil;
+  std::shared_ptr<GVLStats> gvl_stats = std::make_shared<GVLStats>();
+};
+
+// Lock-free stack of free slot indices.
+class SlotStack final {
+ public:
+  explicit SlotStack(int32_t num_slots)
+      : next_(new std::atomic_int32_t[num_slots]), in_use_(new std::atomic_bool[num_slots]),
+        head_(MakeHead(num_slots > 0 ? 0 : -1, 0)) {
+    for (int32_t i = 0; i < num_slots; i++) {
+      next_[i].store(i + 1 < num_slots ? i + 1 : -1);
+      in_use_[i].store(false);
+    }
+  }
+
+  int32_t Pop() {
+    uint64_t head = head_.load();
+    while (true) {
+      const int32_t slot = GetIndex(head);
+      if (slot < 0) {
+        return -1;
+      }
+      const uint64_t new_head = MakeHead(next_[slot].load(), GetTag(head) + 1);
+      if (head_.compare_exchange_weak(head, new_head)) {
+        in_use_[slot].store(true);
+        return slot;
+      }
+    }
+  }
+
+  bool Push(int32_t slot) {
+    bool expected = true;
+    if (!in_use_[slot].compare_exchange_strong(expected, false)) {
+      return false;
+    }
+    uint64_t head = head_.load();
+    while (true) {
+      next_[slot].store(GetIndex(head));
+      if (head_.compare_exchange_weak(head, MakeHead(slot, GetTag(head) + 1))) {
+        return true;
+      }
+    }
+  }
+
+ private:
+  static uint64_t MakeHead(int32_t slot, uint32_t tag) {
+    return ((uint64_t)tag << 32) | (uint32_t)slot;
+  }
+  static int32_t GetIndex(uint64_t head) {
+    return (int32_t)(uint32_t)head;
+  }
+  static uint32_t GetTag(uint64_t head) {
+    return head >> 32;
+  }
+
+  std::unique_ptr<std::atomic_int32_t[]> next_;
+  std::unique_ptr<std::atomic_bool[]> in_use_;
+  std::atomic_uint64_t head_;
+};
+
+// Ruby wrapper of the Pool object.
+struct StructPool {
+  std::unique_ptr<SlotStack> free_slots;
+  int32_t num_readers = 0;
+  std::atomic_int32_t num_available{0};
+  std::mutex mutex;
+  std::condition_variable cond;
+};
+
+// Waiter for a reader of a pool to be checked in, without the GVL.
+struct PoolWaiter {
+  StructPool* spool = nullptr;
+  bool interrupted = false;
+};
+
+// Functions for the wrapped data of the Ruby objects.
+static void status_del(void* ptr);
+static size_t status_memsize(const void* ptr);
+static void future_mark(void* ptr);
+static void future_compact(void* ptr);
+static void future_del(void* ptr);
+static size_t future_memsize(const void* ptr);
+static void dbm_mark(void* ptr);
+static void dbm_compact(void* ptr);
+static void dbm_del(void* ptr);
+static size_t dbm_memsize(const void* ptr);
+static void iter_mark(void* ptr);
+static void iter_compact(void* ptr);
+static void iter_del(void* ptr);
+static size_t iter_memsize(const void* ptr);
+static void asyncdbm_mark(void* ptr);
+static void asyncdbm_compact(void* ptr);
+static void asyncdbm_del(void* ptr);
+static size_t asyncdbm_memsize(const void* ptr);
+static void file_mark(void* ptr);
+static void file_compact(void* ptr);
+static void file_del(void* ptr);
+static size_t file_memsize(const void* ptr);
+static void asyncfile_mark(void* ptr);
+static void asyncfile_compact(void* ptr);
+static void asyncfile_del(void* ptr);
+static size_t asyncfile_memsize(const void* ptr);
+static void index_mark(void* ptr);
+static void index_compact(void* ptr);
+static void index_del(void* ptr);
+static size_t index_memsize(const void* ptr);
+static void indexiter_mark(void* ptr);
+static void indexiter_compact(void* ptr);
+static void indexiter_del(void* ptr);
+static size_t indexiter_memsize(const void* ptr);
+static void pool_del(void* ptr);
+static size_t pool_memsize(const void* ptr);
+
+// Types of the wrapped data of the Ruby objects.  Only the data which don't touch database
+// locks, files, or native threads when freed are freed immediately in the GC.
+static const rb_data_type_t type_status = {
+  "Tkrzw::Status",
+  {nullptr, status_del, status_memsize, nullptr},
+  nullptr, nullptr, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_future = {
+  "Tkrzw::Future",
+  {future_mark, future_del, future_memsize, future_compact},
+  nullptr, nullptr, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_dbm = {
+  "Tkrzw::DBM",
+  {dbm_mark, dbm_del, dbm_memsize, dbm_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_iter = {
+  "Tkrzw::Iterator",
+  {iter_mark, iter_del, iter_memsize, iter_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_asyncdbm = {
+  "Tkrzw::AsyncDBM",
+  {asyncdbm_mark, asyncdbm_del, asyncdbm_memsize, asyncdbm_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_file = {
+  "Tkrzw::File",
+  {file_mark, file_del, file_memsize, file_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_asyncfile = {
+  "Tkrzw::AsyncFile",
+  {asyncfile_mark, asyncfile_del, asyncfile_memsize, asyncfile_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_index = {
+  "Tkrzw::Index",
+  {index_mark, index_del, index_memsize, index_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_indexiter = {
+  "Tkrzw::IndexIterator",
+  {indexiter_mark, indexiter_del, indexiter_memsize, indexiter_compact},
+  nullptr, nullptr, RUBY_TYPED_WB_PROTECTED};
+static const rb_data_type_t type_pool = {
+  "Tkrzw::Pool",
+  {nullptr, pool_del, pool_memsize, nullptr},
+  nullptr, nullptr, RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED};
+
+// Number of updates after which the memory usage of an on-memory database is estimated.
+constexpr int64_t MEMORY_ADJUST_INTERVAL = 1024;
+
+// Estimated memory overhead of each record of on-memory databases.
+constexpr int64_t RECORD_MEMORY_OVERHEAD = 48;
+
+// Number of records sampled to estimate the average record size.
+constexpr int32_t NUM_MEMORY_SAMPLES = 16;
+
+// Checks whether a database stores all records on memory.
+static bool IsOnMemoryDBM(tkrzw::DBM* dbm) {
+  for (const auto& rec : dbm->Inspect()) {
+    if (rec.first == "class") {
+      return rec.second == "TinyDBM" || rec.second == "BabyDBM" || rec.second == "CacheDBM" ||
+          rec.second == "StdHashDBM" || rec.second == "StdTreeDBM";
+    }
+  }
+  return false;
+}
+
+// Checks whether the database class chosen by the path and the parameters is on-memory.
+static bool IsOnMemoryDBMPath(
+    const std::string& path, const std::map<std::string, std::string>& params) {
+  std::string name = tkrzw::StrLowerCase(tkrzw::SearchMap(params, "dbm", ""));
+  if (name.empty()) {
+    name = tkrzw::StrLowerCase(tkrzw::PathToExtension(path));
+  }
+  static const std::set<std::string> on_memory_names = {
+    "tinydbm", "tiny", "tkmt", "babydbm", "baby", "tkmb", "cachedbm", "cache", "tkmc",
+    "stdhashdbm", "stdhash", "tksh", "stdtreedbm", "stdtree", "tkst"};
+  return on_memory_names.find(name) != on_memory_names.end();
+}
+
+// Estimates the memory size of the records by sampling some of them.
+static int64_t EstimateRecordMemorySize(tkrzw::DBM* dbm) {
+  const int64_t count = dbm->CountSimple();
+  if (count <= 0) {
+    return 0;
+  }
+  auto iter = dbm->MakeIterator();
+  int64_t num_samples = 0;
+  int64_t sample_size = 0;
+  std::string key, value;
+  if (iter->First() == tkrzw::Status::SUCCESS) {
+    while (num_samples < NUM_MEMORY_SAMPLES && iter->Get(&key, &value) == tkrzw::Status::SUCCESS) {
+      num_samples++;
+      sample_size += key.size() + value.size();
+      iter->Next();
+    }
+  }
+  const int64_t record_size = num_samples > 0 ? sample_size / num_samples : 0;
+  return count * (record_size + RECORD_MEMORY_OVERHEAD);
+}
+
+// Tells the GC the change of the native memory size of an object.
+static void AdjustMemoryUsage(int64_t* memory_size, int64_t new_size) {
+  if (new_size != *memory_size) {
+    rb_gc_adjust_memory_usage(new_size - *memory_size);
+    *memory_size = new_size;
+  }
+}
+
+// Estimates the memory usage of an on-memory database again and tells it to the GC.
+static void AdjustDBMMemoryUsage(StructDBM* sdbm) {
+  int64_t new_size = 0;
+  if (sdbm->on_memory && sdbm->dbm != nullptr) {
+    NativeFunction(sdbm->concurrent, [&]() {
+        new_size = EstimateRecordMemorySize(sdbm->dbm.get());
+      });
+  }
+  AdjustMemoryUsage(&sdbm->memory_size, new_size);
+  sdbm->num_updates = 0;
+}
+
+// Counts updates of an on-memory database to adjust the memory usage periodically.
+static void CountDBMUpdates(StructDBM* sdbm, int64_t num_updates) {
+  if (sdbm->on_memory) {
+    sdbm->num_updates += num_updates;
+    if (sdbm->num_updates >= MEMORY_ADJUST_INTERVAL) {
+      AdjustDBMMemoryUsage(sdbm);
+    }
+  }
+}
+
+// Estimates the memory usage of an on-memory index again and tells it to the GC.
+static void AdjustIndexMemoryUsage(StructIndex* sindex) {
+  int64_t new_size = 0;
+  if (sindex->on_memory && sindex->index != nullptr) {
+    NativeFunction(sindex->concurrent, [&]() {
+        new_size = EstimateRecordMemorySize(sindex->index->GetInternalDBM());
+      });
+  }
+  AdjustMemoryUsage(&sindex->memory_size, new_size);
+  sindex->num_updates = 0;
+}
+
+// Counts updates of an on-memory index to adjust the memory usage periodically.
+static void CountIndexUpdates(StructIndex* sindex, int64_t num_updates) {
+  if (sindex->on_memory) {
+    sindex->num_updates += num_updates;
+    if (sindex->num_updates >= MEMORY_ADJUST_INTERVAL) {
+      AdjustIndexMemoryUsage(sindex);
+    }
+  }
+}
+
+// Records an operation of an iterator on the trace of its database if the trace is enabled.
+static void RecordIterTrace(StructIter* siter, const char* method, std::string_view key,
+                            int64_t value_size) {
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(siter->vdbm, StructDBM, &type_dbm, sdbm);
+  RecordTrace(sdbm, method, key, value_size);
+}
+
+// Index attached to a database, held on the stack of a method so that detaching the index
+// from another thread doesn't free the index object or the extractor in use.
+struct AttachedIndex {
+  volatile VALUE vindex = Qnil;
+  StructIndex* sindex = nullptr;
+  std::shared_ptr<IndexExtractor> extractor;
 };
 
+// Gets the index attached to a database.  The index is null if no index is attached.
+static AttachedIndex GetAttachedIndex(StructDBM* sdbm) {
+  AttachedIndex attached;
+  if (sdbm->vindex == Qnil) {
+    return attached;
+  }
+  attached.vindex = sdbm->vindex;
+  attached.extractor = sdbm->index_extractor;
+  TypedData_Get_Struct(attached.vindex, StructIndex, &type_index, attached.sindex);
+  if (attached.sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  return attached;
+}
+
+// Raises an error if an index is attached, for methods which don't update it.
+static void CheckNoAttachedIndex(StructDBM* sdbm) {
+  if (sdbm->vindex != Qnil) {
+    rb_raise(rb_eRuntimeError, "not supported with an attached index");
+  }
+}
+
+// Processes a record and updates the attached index in the same call of Process.
+static tkrzw::Status ProcessIndexedRecord(
+    StructDBM* sdbm, const AttachedIndex& attached, std::string_view key,
+    const tkrzw::DBM::RecordLambdaType& func) {
+  tkrzw::Status index_status(tkrzw::Status::SUCCESS);
+  auto wrapper = [&](std::string_view reckey, std::string_view recvalue) -> std::string_view {
+    const std::string_view new_value = func(reckey, recvalue);
+    if (new_value.data() == tkrzw::DBM::RecordProcessor::NOOP.data()) {
+      return new_value;
+    }
+    std::string_view old_field, new_field;
+    const bool has_old = recvalue.data() != tkrzw::DBM::RecordProcessor::NOOP.data() &&
+        attached.extractor->Extract(recvalue, &old_field);
+    const bool has_new = new_value.data() != tkrzw::DBM::RecordProcessor::REMOVE.data() &&
+        attached.extractor->Extract(new_value, &new_field);
+    if (has_old && has_new && old_field == new_field) {
+      return new_value;
+    }
+    if (has_old) {
+      const tkrzw::Status remove_status = attached.sindex->index->Remove(old_field, key);
+      if (remove_status != tkrzw::Status::NOT_FOUND_ERROR) {
+        index_status |= remove_status;
+      }
+    }
+    if (has_new) {
+      index_status |= attached.sindex->index->Add(new_field, key);
+    }
+    return new_value;
+  };
+  tkrzw::Status status = sdbm->dbm->Process(key, wrapper, true);
+  status |= index_status;
+  return status;
+}
+
+// Sets a record and updates the attached index.
+static tkrzw::Status SetIndexedRecord(
+    StructDBM* sdbm, const AttachedIndex& attached, std::string_view key, std::string_view value,
+    bool overwrite) {
+  bool duplicated = false;
+  tkrzw::Status status = ProcessIndexedRecord(
+      sdbm, attached, key, [&](std::string_view, std::string_view old_value) -> std::string_view {
+        if (!overwrite && old_value.data() != tkrzw::DBM::RecordProcessor::NOOP.data()) {
+          duplicated = true;
+          return tkrzw::DBM::RecordProcessor::NOOP;
+        }
+        return value;
+      });
+  if (duplicated && status.IsOK()) {
+    status.Set(tkrzw::Status::DUPLICATION_ERROR);
+  }
+  return status;
+}
+
+// Appends a value to a record and updates the attached index.
+static tkrzw::Status AppendIndexedRecord(
+    StructDBM* sdbm, const AttachedIndex& attached, std::string_view key, std::string_view value,
+    std::string_view delim) {
+  std::string new_value;
+  return ProcessIndexedRecord(
+      sdbm, attached, key, [&](std::string_view, std::string_view old_value) -> std::string_view {
+        if (old_value.data() == tkrzw::DBM::RecordProcessor::NOOP.data()) {
+          return value;
+        }
+        new_value.reserve(old_value.size() + delim.size() + value.size());
+        new_value.append(old_value).append(delim).append(value);
+        return new_value;
+      });
+}
+
+// Removes a record and updates the attached index.
+static tkrzw::Status RemoveIndexedRecord(
+    StructDBM* sdbm, const AttachedIndex& attached, std::string_view key) {
+  bool missing = false;
+  tkrzw::Status status = ProcessIndexedRecord(
+      sdbm, attached, key, [&](std::string_view, std::string_view old_value) -> std::string_view {
+        if (old_value.data() == tkrzw::DBM::RecordProcessor::NOOP.data()) {
+          missing = true;
+          return tkrzw::DBM::RecordProcessor::NOOP;
+        }
+        return tkrzw::DBM::RecordProcessor::REMOVE;
+      });
+  if (missing && status.IsOK()) {
+    status.Set(tkrzw::Status::NOT_FOUND_ERROR);
+  }
+  return status;
+}
+
+// Starts the worker threads to run operations on multiple shards in parallel.
+static void StartShardWorkers(StructDBM* sdbm, int32_t num_shards) {
+  sdbm->num_shards = num_shards;
+  if (num_shards < 2) {
+    return;
+  }
+  const int32_t num_cores = std::max<int32_t>(std::thread::hardware_concurrency(), 1);
+  sdbm->shard_queue = std::make_unique<tkrzw::TaskQueue>();
+  sdbm->shard_queue->Start(std::min(num_shards, num_cores));
+  sdbm->shard_pid = getpid();
+}
+
+// Stops the worker threads for the shards.
+static void StopShardWorkers(StructDBM* sdbm) {
+  if (sdbm->shard_queue != nullptr) {
+    if (sdbm->shard_pid == getpid()) {
+      sdbm->shard_queue->Stop(tkrzw::INT32MAX);
+      sdbm->shard_queue.reset(nullptr);
+    } else {
+      // The worker threads don't exist in a forked child process, so they can't be joined.
+      sdbm->shard_queue.release();
+    }
+  }
+  sdbm->num_shards = 0;
+}
+
+// Restarts the worker threads for the shards in a forked child process.
+static void RestartShardWorkersAfterFork(StructDBM* sdbm) {
+  if (sdbm->shard_queue != nullptr && sdbm->shard_pid != getpid()) {
+    sdbm->shard_queue.release();
+    StartShardWorkers(sdbm, sdbm->num_shards);
+  }
+}
+
+// Groups keys by the shard which the sharded database assigns to them.
+static std::vector<std::vector<std::string_view>> GroupKeysByShard(
+    const std::vector<std::string_view>& keys, int32_t num_shards) {
+  std::vector<std::vector<std::string_view>> groups(num_shards);
+  for (const auto& key : keys) {
+    groups[tkrzw::SecondaryHash(key, num_shards)].emplace_back(key);
+  }
+  groups.erase(std::remove_if(groups.begin(), groups.end(),
+                              [](const std::vector<std::string_view>& group) {
+                                return group.empty();
+                              }), groups.end());
+  return groups;
+}
+
+// Runs tasks on the shard workers and waits for all of them to finish.
+static void RunShardTasks(StructDBM* sdbm, const std::vector<std::function<void(void)>>& tasks) {
+  if (sdbm->shard_pid != getpid()) {
+    // The workers were started by the parent process and don't exist after fork.
+    for (const auto& task : tasks) {
+      task();
+    }
+    return;
+  }
+  std::vector<std::future<void>> futures;
+  futures.reserve(tasks.size());
+  for (size_t i = 1; i < tasks.size(); i++) {
+    auto promise = std::make_shared<std::promise<void>>();
+    futures.emplace_back(promise->get_future());
+    const auto* task = &tasks[i];
+    sdbm->shard_queue->Add([task, promise]() {
+        (*task)();
+        promise->set_value();
+      });
+  }
+  if (!tasks.empty()) {
+    tasks.front()();
+  }
+  for (auto& future : futures) {
+    future.wait();
+  }
+}
+
+// Databases to be reopened in the child process after fork.
+static std::set<StructDBM*> dbms_to_reopen_on_fork;
+
+// Reopens the database as read-only in the child process after fork.
+static tkrzw::Status ReopenDBMAfterFork(StructDBM* sdbm) {
+  // The trace file is written by the parent process, so the child stops recording.
+  sdbm->trace.release();
+  // On-memory databases live in the inherited heap, whose records may not be synchronized
+  // to the file yet, so they are kept even if they were opened with a path.
+  if (sdbm->open_path.empty() || sdbm->on_memory ||
+      IsOnMemoryDBMPath(sdbm->open_path, sdbm->open_params)) {
+    RestartShardWorkersAfterFork(sdbm);
+    return tkrzw::Status(tkrzw::Status::SUCCESS);
+  }
+  // Opening the files again without the lock would let the parent and the child update
+  // them at the same time, and the lock couldn't be taken because the parent holds it.
+  if (sdbm->open_writable) {
+    return tkrzw::Status(tkrzw::Status::PRECONDITION_ERROR,
+                         "the database was opened as writable by the parent process");
+  }
+  // The handles inherited from the parent process are leaked on purpose.  Closing them
+  // would flush and unlock the files which the parent process still uses, and the worker
+  // threads don't exist in the child process.
+  sdbm->dbm.release();
+  sdbm->shard_queue.release();
+  const int32_t options = sdbm->open_options & ~tkrzw::File::OPEN_TRUNCATE;
+  const bool sharded = sdbm->open_params.find("num_shards") != sdbm->open_params.end();
+  if (sharded) {
+    sdbm->dbm.reset(new tkrzw::ShardDBM());
+  } else {
+    sdbm->dbm.reset(new tkrzw::PolyDBM());
+  }
+  const tkrzw::Status status = sdbm->dbm->OpenAdvanced(
+      sdbm->open_path, false, options, sdbm->open_params);
+  if (status != tkrzw::Status::SUCCESS) {
+    sdbm->dbm.reset(nullptr);
+    sdbm->num_shards = 0;
+    dbms_to_reopen_on_fork.erase(sdbm);
+    return status;
+  }
+  if (sharded) {
+    StartShardWorkers(sdbm, sdbm->num_shards);
+  }
+  return status;
+}
+
+// Bounded queue to pass batches of records from native threads to the Ruby thread.
+class RecordBatchQueue final {
+ public:
+  typedef std::vector<std::pair<std::string, std::string>> Batch;
+
+  RecordBatchQueue(size_t capacity, int32_t num_producers)
+      : capacity_(capacity), num_producers_(num_producers) {}
+
+  bool Push(Batch&& batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&]() { return canceled_ || batches_.size() < capacity_; });
+    if (canceled_) {
+      return false;
+    }
+    batches_.emplace_back(std::move(batch));
+    cond_.notify_all();
+    return true;
+  }
+
+  bool Pop(Batch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&]() { return canceled_ || !batches_.empty() || num_producers_ < 1; });
+    if (canceled_ || batches_.empty()) {
+      return false;
+    }
+    *batch = std::move(batches_.front());
+    batches_.pop_front();
+    cond_.notify_all();
+    return true;
+  }
+
+  void FinishProducer() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_producers_--;
+    cond_.notify_all();
+  }
+
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    canceled_ = true;
+    cond_.notify_all();
+  }
+
+  bool IsCanceled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return canceled_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Batch> batches_;
+  size_t capacity_;
+  int32_t num_producers_;
+  bool canceled_ = false;
+};
+
+// Context to pop a batch from the queue without the GVL.
+struct RecordBatchPopper {
+  RecordBatchQueue* queue;
+  RecordBatchQueue::Batch batch;
+  bool popped = false;
+};
+
+// Pops a batch from the queue.  This is called without the GVL.
+static void* PopRecordBatch(void* param) {
+  RecordBatchPopper* popper = (RecordBatchPopper*)param;
+  popper->popped = popper->queue->Pop(&popper->batch);
+  return nullptr;
+}
+
+// Joins native threads.  This is called without the GVL.
+static void* JoinNativeThreads(void* param) {
+  for (auto& thread : *(std::vector<std::thread>*)param) {
+    thread.join();
+  }
+  return nullptr;
+}
+
+// Cancels the queue to interrupt the native threads.
+static void CancelRecordBatchQueue(void* param) {
+  ((RecordBatchQueue*)param)->Cancel();
+}
+
+// Starts native threads to produce batches for the queue.  If a thread cannot be started, the
+// queue is canceled and the threads already started are joined.
+static tkrzw::Status StartNativeThreads(
+    std::vector<std::thread>* threads, int32_t num_threads, const std::function<void()>& func,
+    RecordBatchQueue* queue) {
+  try {
+    for (int32_t i = 0; i < num_threads; i++) {
+      threads->emplace_back(func);
+    }
+  } catch (const std::system_error& err) {
+    queue->Cancel();
+    rb_thread_call_without_gvl(JoinNativeThreads, threads, CancelRecordBatchQueue, queue);
+    threads->clear();
+    return tkrzw::Status(tkrzw::Status::SYSTEM_ERROR, err.what());
+  }
+  return tkrzw::Status(tkrzw::Status::SUCCESS);
+}
+
 // Implementation of Utility.get_memory_capacity.
 static VALUE util_get_memory_capacity(VALUE vself) {
   return LL2NUM(tkrzw::GetMemoryCapacity());
@@ -429,10 +1788,16 @@ static void status_del(void* ptr) {
   delete (tkrzw::Status*)ptr;
 }
 
+// Implementation of Status#memsize.
+static size_t status_memsize(const void* ptr) {
+  const tkrzw::Status* status = (const tkrzw::Status*)ptr;
+  return sizeof(*status) + status->GetMessage().size();
+}
+
 // Implementation of Status.new.
 static VALUE status_new(VALUE cls) {
   tkrzw::Status* status = new tkrzw::Status(tkrzw::Status::SUCCESS);
-  return Data_Wrap_Struct(cls_status, 0, status_del, status);
+  return TypedData_Wrap_Struct(cls_status, &type_status, status);
 }
 
 // Implementation of Status#initialize.
@@ -447,7 +1812,7 @@ static VALUE status_initialize(int argc, VALUE* argv, VALUE vself) {
   }
   vmessage = StringValueEx(vmessage);
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   status->Set((tkrzw::Status::Code)NUM2INT(vcode), GetStringView(vmessage));
   return Qnil;
 }
@@ -464,7 +1829,7 @@ static VALUE status_set(int argc, VALUE* argv, VALUE vself) {
   }
   vmessage = StringValueEx(vmessage);
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   status->Set((tkrzw::Status::Code)NUM2INT(vcode), GetStringView(vmessage));
   return Qnil;
 }
@@ -472,12 +1837,12 @@ static VALUE status_set(int argc, VALUE* argv, VALUE vself) {
 // Implementation of Status#join.
 static VALUE status_join(VALUE vself, VALUE vrht) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   if (!rb_obj_is_instance_of(vrht, cls_status)) {
     rb_raise(rb_eRuntimeError, "not a status");
   }
   tkrzw::Status* rht = nullptr;
-  Data_Get_Struct(vrht, tkrzw::Status, rht);
+  TypedData_Get_Struct(vrht, tkrzw::Status, &type_status, rht);
   *status |= *rht;
   return Qnil;
 }
@@ -485,14 +1850,14 @@ static VALUE status_join(VALUE vself, VALUE vrht) {
 // Implementation of Status#code.
 static VALUE status_code(VALUE vself) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   return INT2FIX(status->GetCode());
 }
 
 // Implementation of Status#get_message.
 static VALUE status_message(VALUE vself) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   const std::string_view message = status->GetMessage();
   return rb_str_new(message.data(), message.size());
 }
@@ -500,14 +1865,14 @@ static VALUE status_message(VALUE vself) {
 // Implementation of Status#ok?.
 static VALUE status_ok(VALUE vself) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   return status->IsOK() ? Qtrue : Qfalse;
 }
 
 // Implementation of Status#or_die.
 static VALUE status_or_die(VALUE vself) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   if (!status->IsOK()) {
     // TODO: The thrown exception should be initialized with the status object.
     const std::string& message = tkrzw::ToString(*status);
@@ -519,7 +1884,7 @@ static VALUE status_or_die(VALUE vself) {
 // Implementation of Status#to_s.
 static VALUE status_to_s(VALUE vself) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   const std::string str = tkrzw::ToString(*status);
   return rb_str_new(str.data(), str.size());
 }
@@ -527,7 +1892,7 @@ static VALUE status_to_s(VALUE vself) {
 // Implementation of Status#inspect.
 static VALUE status_inspect(VALUE vself) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   const std::string str = tkrzw::StrCat("#<Tkrzw::Status:", *status, ">");
   return rb_str_new(str.data(), str.size());
 }
@@ -535,11 +1900,11 @@ static VALUE status_inspect(VALUE vself) {
 // Implementation of Status#op_eq.
 static VALUE status_op_eq(VALUE vself, VALUE vrhs) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   int32_t rcode = 0;
   if (rb_obj_is_instance_of(vrhs, cls_status)) {
     tkrzw::Status* rstatus = nullptr;
-    Data_Get_Struct(vrhs, tkrzw::Status, rstatus);
+    TypedData_Get_Struct(vrhs, tkrzw::Status, &type_status, rstatus);
     rcode = rstatus->GetCode();
   } else if (TYPE(vrhs) == T_FIXNUM) {
     rcode = FIX2INT(vrhs);
@@ -552,11 +1917,11 @@ static VALUE status_op_eq(VALUE vself, VALUE vrhs) {
 // Implementation of Status#op_ne.
 static VALUE status_op_ne(VALUE vself, VALUE vrhs) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vself, tkrzw::Status, status);
+  TypedData_Get_Struct(vself, tkrzw::Status, &type_status, status);
   int32_t rcode = 0;
   if (rb_obj_is_instance_of(vrhs, cls_status)) {
     tkrzw::Status* rstatus = nullptr;
-    Data_Get_Struct(vrhs, tkrzw::Status, rstatus);
+    TypedData_Get_Struct(vrhs, tkrzw::Status, &type_status, rstatus);
     rcode = rstatus->GetCode();
   } else if (TYPE(vrhs) == T_FIXNUM) {
     rcode = FIX2INT(vrhs);
@@ -574,16 +1939,23 @@ static VALUE status_code_name(VALUE vself, VALUE vcode) {
 // Creates a status object.
 static VALUE MakeStatusValue(tkrzw::Status&& status) {
   tkrzw::Status* new_status = new tkrzw::Status(status);
-  return Data_Wrap_Struct(cls_status, 0, status_del, new_status);
+  return TypedData_Wrap_Struct(cls_status, &type_status, new_status);
 }
 
 // Sets a status object.
 static void SetStatusValue(VALUE vstatus, const tkrzw::Status& rhs) {
   tkrzw::Status* status = nullptr;
-  Data_Get_Struct(vstatus, tkrzw::Status, status);
+  TypedData_Get_Struct(vstatus, tkrzw::Status, &type_status, status);
   *status = rhs;
 }
 
+// Gets the native status of a status object.
+static tkrzw::Status GetStatusValue(VALUE vstatus) {
+  tkrzw::Status* status = nullptr;
+  TypedData_Get_Struct(vstatus, tkrzw::Status, &type_status, status);
+  return *status;
+}
+
 // Defines the Status class.
 static void DefineStatus() {
   cls_status = rb_define_class_under(mod_tkrzw, "Status", rb_cObject);
@@ -631,6 +2003,18 @@ static void DefineStatus() {
   rb_define_singleton_method(cls_status, "code_name", (METHOD)status_code_name, 1);
 }
 
+// Implementation of Future#mark.
+static void future_mark(void* ptr) {
+  StructFuture* sfuture = (StructFuture*)ptr;
+  rb_gc_mark_movable(sfuture->venc);
+}
+
+// Implementation of Future#compact.
+static void future_compact(void* ptr) {
+  StructFuture* sfuture = (StructFuture*)ptr;
+  sfuture->venc = rb_gc_location(sfuture->venc);
+}
+
 // Implementation of Future#del.
 static void future_del(void* ptr) {
   StructFuture* sfuture = (StructFuture*)ptr;
@@ -638,10 +2022,15 @@ static void future_del(void* ptr) {
   delete sfuture;
 }
 
+// Implementation of Future#memsize.
+static size_t future_memsize(const void* ptr) {
+  return sizeof(StructFuture);
+}
+
 // Implementation of Future.new.
 static VALUE future_new(VALUE cls) {
   StructFuture* sfuture = new StructFuture;
-  return Data_Wrap_Struct(cls_future, 0, future_del, sfuture);
+  return TypedData_Wrap_Struct(cls_future, &type_future, sfuture);
 }
 
 // Implementation of Future#initialize.
@@ -653,7 +2042,7 @@ static VALUE future_initialize(int argc, VALUE* argv, VALUE vself) {
 // Implementation of Future#destruct.
 static VALUE future_destruct(VALUE vself) {
   StructFuture* sfuture = nullptr;
-  Data_Get_Struct(vself, StructFuture, sfuture);
+  TypedData_Get_Struct(vself, StructFuture, &type_future, sfuture);
   sfuture->future.reset(nullptr);
   return Qnil;
 }
@@ -661,7 +2050,7 @@ static VALUE future_destruct(VALUE vself) {
 // Implementation of Future#wait.
 static VALUE future_wait(int argc, VALUE* argv, VALUE vself) {
   StructFuture* sfuture = nullptr;
-  Data_Get_Struct(vself, StructFuture, sfuture);
+  TypedData_Get_Struct(vself, StructFuture, &type_future, sfuture);
   if (sfuture->future == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -682,7 +2071,7 @@ static VALUE future_wait(int argc, VALUE* argv, VALUE vself) {
 // Implementation of Future#get.
 static VALUE future_get(VALUE vself) {
   StructFuture* sfuture = nullptr;
-  Data_Get_Struct(vself, StructFuture, sfuture);
+  TypedData_Get_Struct(vself, StructFuture, &type_future, sfuture);
   if (sfuture->future == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -768,7 +2157,7 @@ static VALUE future_get(VALUE vself) {
 // Implementation of Future#to_s.
 static VALUE future_to_s(VALUE vself) {
   StructFuture* sfuture = nullptr;
-  Data_Get_Struct(vself, StructFuture, sfuture);
+  TypedData_Get_Struct(vself, StructFuture, &type_future, sfuture);
   if (sfuture->future == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -779,7 +2168,7 @@ static VALUE future_to_s(VALUE vself) {
 // Implementation of Future#inspect.
 static VALUE future_inspect(VALUE vself) {
   StructFuture* sfuture = nullptr;
-  Data_Get_Struct(vself, StructFuture, sfuture);
+  TypedData_Get_Struct(vself, StructFuture, &type_future, sfuture);
   if (sfuture->future == nullptr) {
     return rb_str_new2("#<Tkrzw::Future:(destructed object)>");
   }
@@ -791,9 +2180,10 @@ static VALUE future_inspect(VALUE vself) {
 static VALUE MakeFutureValue(tkrzw::StatusFuture&& future, bool concurrent, VALUE venc) {
   StructFuture* sfuture = new StructFuture;
   sfuture->future = std::make_unique<tkrzw::StatusFuture>(std::move(future));
-  sfuture->concurrent = false;
-  sfuture->venc = Qnil;
-  return Data_Wrap_Struct(cls_future, 0, future_del, sfuture);
+  sfuture->concurrent = concurrent;
+  volatile VALUE vfuture = TypedData_Wrap_Struct(cls_future, &type_future, sfuture);
+  RB_OBJ_WRITE(vfuture, &sfuture->venc, venc);
+  return vfuture;
 }
 
 // Defines the Future class.
@@ -853,36 +2243,66 @@ static void DefineStatusException() {
   id_expt_status = rb_intern("@status");
 }
 
+// Implementation of DBM#mark.
+static void dbm_mark(void* ptr) {
+  StructDBM* sdbm = (StructDBM*)ptr;
+  rb_gc_mark_movable(sdbm->venc);
+  rb_gc_mark_movable(sdbm->vindex);
+}
+
+// Implementation of DBM#compact.
+static void dbm_compact(void* ptr) {
+  StructDBM* sdbm = (StructDBM*)ptr;
+  sdbm->venc = rb_gc_location(sdbm->venc);
+  sdbm->vindex = rb_gc_location(sdbm->vindex);
+}
+
 // Implementation of DBM#del.
 static void dbm_del(void* ptr) {
   StructDBM* sdbm = (StructDBM*)ptr;
+  dbms_to_reopen_on_fork.erase(sdbm);
+  StopShardWorkers(sdbm);
   sdbm->dbm.reset(nullptr);
+  AdjustMemoryUsage(&sdbm->memory_size, 0);
   delete sdbm;
 }
 
+// Implementation of DBM#memsize.
+static size_t dbm_memsize(const void* ptr) {
+  const StructDBM* sdbm = (const StructDBM*)ptr;
+  return sizeof(*sdbm) + sdbm->memory_size +
+      (sdbm->read_cache == nullptr ? 0 : sdbm->read_cache->GetMemorySize()) +
+      (sdbm->bloom_filter == nullptr ? 0 : sdbm->bloom_filter->GetNumBits() / 8);
+}
+
 // Implementation of DBM.new.
 static VALUE dbm_new(VALUE cls) {
   StructDBM* sdbm = new StructDBM;
-  return Data_Wrap_Struct(cls_dbm, 0, dbm_del, sdbm);
+  return TypedData_Wrap_Struct(cls_dbm, &type_dbm, sdbm);
 }
 
 // Implementation of DBM#initialize.
 static VALUE dbm_initialize(VALUE vself) {
+  ProbeScope probe("DBM#initialize");
   return Qnil;
 }
 
 // Implementation of DBM#destruct.
 static VALUE dbm_destruct(VALUE vself) {
+  ProbeScope probe("DBM#destruct");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  dbms_to_reopen_on_fork.erase(sdbm);
+  StopShardWorkers(sdbm);
   sdbm->dbm.reset(nullptr);
   return Qnil;
 }
 
 // Implementation of DBM#open.
 static VALUE dbm_open(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#open");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm != nullptr) {
     rb_raise(rb_eRuntimeError, "opened database");
   }
@@ -917,6 +2337,24 @@ static VALUE dbm_open(int argc, VALUE* argv, VALUE vself) {
   if (encoding.empty()) {
     encoding = "ASCII-8BIT";
   }
+  const bool reopen_on_fork =
+      tkrzw::StrToBool(tkrzw::SearchMap(params, "reopen_on_fork", "false"));
+  const bool latency_stats =
+      tkrzw::StrToBool(tkrzw::SearchMap(params, "latency_stats", "false"));
+  const auto& read_cache_params = GetNestedParams(vparams, "read_cache");
+  const int64_t read_cache_capacity =
+      tkrzw::StrToInt(tkrzw::SearchMap(read_cache_params, "capacity", "0"));
+  const int64_t read_cache_max_value_size =
+      tkrzw::StrToInt(tkrzw::SearchMap(read_cache_params, "max_value_size", "4096"));
+  const std::string bloom_filter_expr = tkrzw::SearchMap(params, "bloom_filter", "false");
+  const bool bloom_filter = !bloom_filter_expr.empty() && bloom_filter_expr != "false";
+  const auto& bloom_filter_params = GetNestedParams(vparams, "bloom_filter");
+  const int64_t bloom_filter_capacity =
+      tkrzw::StrToInt(tkrzw::SearchMap(bloom_filter_params, "capacity", "0"));
+  const double bloom_filter_error_rate =
+      tkrzw::StrToDouble(tkrzw::SearchMap(bloom_filter_params, "error_rate", "0.01"));
+  const int64_t max_interned_size =
+      tkrzw::StrToInt(tkrzw::SearchMap(params, "intern_values", "0"));
   params.erase("concurrent");
   params.erase("truncate");
   params.erase("no_create");
@@ -924,39 +2362,92 @@ static VALUE dbm_open(int argc, VALUE* argv, VALUE vself) {
   params.erase("no_lock");
   params.erase("sync_hard");
   params.erase("encoding");
+  params.erase("reopen_on_fork");
+  params.erase("latency_stats");
+  params.erase("read_cache");
+  params.erase("bloom_filter");
+  params.erase("intern_values");
   if (num_shards >= 0) {
     sdbm->dbm.reset(new tkrzw::ShardDBM());
   } else {
     sdbm->dbm.reset(new tkrzw::PolyDBM());
   }
   sdbm->concurrent = concurrent;
-  sdbm->venc = GetEncoding(encoding);
+  sdbm->max_interned_size = max_interned_size;
+  RB_OBJ_WRITE(vself, &sdbm->venc, GetEncoding(encoding));
+  if (latency_stats) {
+    sdbm->latency_stats = std::make_shared<LatencyStats>();
+  } else {
+    sdbm->latency_stats.reset();
+  }
+  if (read_cache_capacity > 0) {
+    sdbm->read_cache =
+        std::make_shared<ReadCache>(read_cache_capacity, read_cache_max_value_size);
+  } else {
+    sdbm->read_cache.reset();
+  }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->OpenAdvanced(std::string(path), writable, open_options, params);
-    });
+    }, sdbm->gvl_stats.get());
+  if (status == tkrzw::Status::SUCCESS) {
+    sdbm->open_path = path;
+    sdbm->open_writable = writable;
+    sdbm->open_options = open_options;
+    sdbm->open_params = params;
+    if (reopen_on_fork) {
+      dbms_to_reopen_on_fork.emplace(sdbm);
+    }
+    sdbm->on_memory = num_shards < 0 && IsOnMemoryDBM(sdbm->dbm.get());
+    AdjustDBMMemoryUsage(sdbm);
+  }
+  if (status == tkrzw::Status::SUCCESS && num_shards >= 0) {
+    int32_t actual_num_shards = num_shards;
+    if (tkrzw::ShardDBM::GetNumberOfShards(std::string(path), &actual_num_shards) !=
+        tkrzw::Status::SUCCESS) {
+      actual_num_shards = num_shards;
+    }
+    StartShardWorkers(sdbm, actual_num_shards);
+  }
+  if (status == tkrzw::Status::SUCCESS && bloom_filter) {
+    status = BuildBloomFilter(sdbm, bloom_filter_capacity, bloom_filter_error_rate);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#close.
 static VALUE dbm_close(VALUE vself) {
+  ProbeScope probe("DBM#close");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Close();
-    });
+    }, sdbm->gvl_stats.get());
+  dbms_to_reopen_on_fork.erase(sdbm);
+  StopShardWorkers(sdbm);
   sdbm->dbm.reset(nullptr);
+  sdbm->read_cache.reset();
+  sdbm->bloom_filter.reset(nullptr);
+  sdbm->on_memory = false;
+  AdjustDBMMemoryUsage(sdbm);
+  if (sdbm->trace != nullptr) {
+    status |= sdbm->trace->Close();
+    sdbm->trace.reset(nullptr);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#process.
 static VALUE dbm_process(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#process");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -968,6 +2459,7 @@ static VALUE dbm_process(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "20", &vkey, &vwritable);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const bool writable = RTEST(vwritable);
   std::string rvph;
   bool block_error = false;
@@ -993,33 +2485,58 @@ static VALUE dbm_process(int argc, VALUE* argv, VALUE vself) {
     }
     return rv;
   };
-  tkrzw::Status status = sdbm->dbm->Process(key, func, writable);
+  if (writable) {
+    AddToBloomFilter(sdbm, key);
+  }
+  const AttachedIndex attached = writable ? GetAttachedIndex(sdbm) : AttachedIndex();
+  LatencyTimer timer(GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  tkrzw::Status status = attached.sindex == nullptr ?
+      sdbm->dbm->Process(key, func, writable) : ProcessIndexedRecord(sdbm, attached, key, func);
+  RecordTrace(sdbm, "process", key, -1);
+  if (writable) {
+    InvalidateReadCache(sdbm, key);
+    CountDBMUpdates(sdbm, 1);
+    if (attached.sindex != nullptr) {
+      CountIndexUpdates(attached.sindex, 1);
+    }
+  }
   if (block_error && status.IsOK()) {
     status.Set(tkrzw::Status::UNKNOWN_ERROR, "exception from the block code");
   }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#include?.
 static VALUE dbm_include(VALUE vself, VALUE vkey) {
+  ProbeScope probe("DBM#include?");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   tkrzw::Status status(tkrzw::Status::SUCCESS);
-  NativeFunction(sdbm->concurrent, [&]() {
-      status = sdbm->dbm->Get(key);
-    });
+  std::string value;
+  if (!MayContainKey(sdbm, key)) {
+    status.Set(tkrzw::Status::NOT_FOUND_ERROR);
+  } else if (sdbm->read_cache == nullptr || !sdbm->read_cache->Get(key, &value)) {
+    // The value is not copied on a miss, as it is not cached by this method.
+    NativeFunction(sdbm->concurrent, [&]() {
+        status = sdbm->dbm->Get(key);
+      }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_GET));
+  }
+  RecordTrace(sdbm, "include", key, -1);
   return status == tkrzw::Status::SUCCESS ? Qtrue : Qfalse;
 }
 
 // Implementation of DBM#get.
 static VALUE dbm_get(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#get");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1027,24 +2544,28 @@ static VALUE dbm_get(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vkey, &vstatus);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   std::string value;
-  tkrzw::Status status(tkrzw::Status::SUCCESS);
-  NativeFunction(sdbm->concurrent, [&]() {
-      status = sdbm->dbm->Get(key, &value);
-    });
+  tkrzw::Status status = MayContainKey(sdbm, key) ?
+      GetWithReadCache(sdbm, key, &value) : tkrzw::Status(tkrzw::Status::NOT_FOUND_ERROR);
+  RecordTrace(sdbm, "get", key,
+              status == tkrzw::Status::SUCCESS ? static_cast<int64_t>(value.size()) : -1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
   if (status == tkrzw::Status::SUCCESS) {
-    return MakeString(value, sdbm->venc);
+    probe.SetValueSize(value.size());
+    return MakeValueString(value, sdbm->venc, sdbm->max_interned_size);
   }
   return Qnil;
 }
 
 // Implementation of DBM#get_multi.
 static VALUE dbm_get_multi(VALUE vself, VALUE vkeys) {
+  ProbeScope probe("DBM#get_multi");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1058,15 +2579,64 @@ static VALUE dbm_get_multi(VALUE vself, VALUE vkeys) {
     vkey = StringValueEx(vkey);
     keys.emplace_back(std::string(RSTRING_PTR(vkey), RSTRING_LEN(vkey)));
   }
-  std::vector<std::string_view> key_views(keys.begin(), keys.end());
+  ReadCache* cache = sdbm->read_cache.get();
+  std::vector<std::string_view> key_views;
+  std::vector<uint64_t> epochs;
+  std::map<std::string, std::string> cached_records;
+  for (const auto& key : keys) {
+    std::string value;
+    if (!MayContainKey(sdbm, key)) {
+      continue;
+    } else if (cache == nullptr) {
+      key_views.emplace_back(key);
+    } else if (cache->Get(key, &value)) {
+      cached_records.emplace(key, std::move(value));
+    } else {
+      key_views.emplace_back(key);
+      epochs.emplace_back(cache->GetEpoch(key));
+    }
+  }
   std::map<std::string, std::string> records;
-  NativeFunction(sdbm->concurrent, [&]() {
-      sdbm->dbm->GetMulti(key_views, &records);
-    });
+  if (!key_views.empty()) {
+    NativeFunction(sdbm->concurrent, [&]() {
+        if (sdbm->shard_queue == nullptr || key_views.size() < 2) {
+          sdbm->dbm->GetMulti(key_views, &records);
+          return;
+        }
+        const auto& groups = GroupKeysByShard(key_views, sdbm->num_shards);
+        std::vector<std::map<std::string, std::string>> group_records(groups.size());
+        std::vector<std::function<void(void)>> tasks;
+        for (size_t i = 0; i < groups.size(); i++) {
+          tasks.emplace_back([&, i]() {
+              sdbm->dbm->GetMulti(groups[i], &group_records[i]);
+            });
+        }
+        RunShardTasks(sdbm, tasks);
+        for (auto& group_record : group_records) {
+          records.merge(group_record);
+        }
+      }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_GET));
+  }
+  if (cache != nullptr) {
+    for (size_t i = 0; i < key_views.size(); i++) {
+      const auto it = records.find(std::string(key_views[i]));
+      if (it != records.end()) {
+        cache->Add(it->first, it->second, epochs[i]);
+      }
+    }
+    records.merge(cached_records);
+  }
+  if (sdbm->trace != nullptr) {
+    for (const auto& key : keys) {
+      const auto it = records.find(key);
+      RecordTrace(sdbm, "get", key,
+                  it == records.end() ? -1 : static_cast<int64_t>(it->second.size()));
+    }
+  }
   volatile VALUE vhash = rb_hash_new();
   for (const auto& record : records) {
     volatile VALUE vkey = rb_str_new(record.first.data(), record.first.size());
-    volatile VALUE vvalue = rb_str_new(record.second.data(), record.second.size());
+    volatile VALUE vvalue = MakeValueString(record.second, Qnil, sdbm->max_interned_size);
     rb_hash_aset(vhash, vkey, vvalue);
   }
   return vhash;
@@ -1074,8 +2644,9 @@ static VALUE dbm_get_multi(VALUE vself, VALUE vkeys) {
 
 // Implementation of DBM#set.
 static VALUE dbm_set(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#set");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1083,20 +2654,36 @@ static VALUE dbm_set(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "21", &vkey, &vvalue, &voverwrite);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   const bool overwrite = argc > 2 ? RTEST(voverwrite) : true;
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
+  AddToBloomFilter(sdbm, key);
   NativeFunction(sdbm->concurrent, [&]() {
+      if (attached.sindex != nullptr) {
+        status = SetIndexedRecord(sdbm, attached, key, value, overwrite);
+        return;
+      }
       status = sdbm->dbm->Set(key, value, overwrite);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SET));
+  RecordTrace(sdbm, "set", key, value.size());
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, 1);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#set_multi.
 static VALUE dbm_set_multi(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#set_multi");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1114,26 +2701,73 @@ static VALUE dbm_set_multi(int argc, VALUE* argv, VALUE vself) {
     record_views.emplace(std::make_pair(
         std::string_view(record.first), std::string_view(record.second)));
   }
+  for (const auto& record : record_views) {
+    AddToBloomFilter(sdbm, record.first);
+  }
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
-      status = sdbm->dbm->SetMulti(record_views, overwrite);
-    });
+      if (attached.sindex != nullptr) {
+        for (const auto& record : record_views) {
+          status |= SetIndexedRecord(sdbm, attached, record.first, record.second, overwrite);
+        }
+        return;
+      }
+      if (sdbm->shard_queue == nullptr || record_views.size() < 2) {
+        status = sdbm->dbm->SetMulti(record_views, overwrite);
+        return;
+      }
+      std::vector<std::map<std::string_view, std::string_view>> groups(sdbm->num_shards);
+      for (const auto& record : record_views) {
+        groups[tkrzw::SecondaryHash(record.first, sdbm->num_shards)].emplace(record);
+      }
+      std::vector<tkrzw::Status> group_statuses(groups.size());
+      std::vector<std::function<void(void)>> tasks;
+      for (size_t i = 0; i < groups.size(); i++) {
+        if (!groups[i].empty()) {
+          tasks.emplace_back([&, i]() {
+              group_statuses[i] = sdbm->dbm->SetMulti(groups[i], overwrite);
+            });
+        }
+      }
+      RunShardTasks(sdbm, tasks);
+      for (const auto& group_status : group_statuses) {
+        status |= group_status;
+      }
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SET));
+  if (sdbm->trace != nullptr) {
+    for (const auto& record : records) {
+      RecordTrace(sdbm, "set", record.first, record.second.size());
+    }
+  }
+  for (const auto& record : records) {
+    InvalidateReadCache(sdbm, record.first);
+  }
+  CountDBMUpdates(sdbm, records.size());
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, records.size());
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#set_and_get.
 static VALUE dbm_set_and_get(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#set_and_get");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   volatile VALUE vkey, vvalue, voverwrite;
   rb_scan_args(argc, argv, "21", &vkey, &vvalue, &voverwrite);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   const bool overwrite = argc > 2 ? RTEST(voverwrite) : true;
   tkrzw::Status impl_status(tkrzw::Status::SUCCESS);
   std::string old_value;
@@ -1165,9 +2799,13 @@ static VALUE dbm_set_and_get(int argc, VALUE* argv, VALUE vself) {
   };
   Processor proc(&impl_status, value, overwrite, &old_value, &hit);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
+  AddToBloomFilter(sdbm, key);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Process(key, &proc, true);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SET));
+  RecordTrace(sdbm, "set", key, value.size());
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
   status |= impl_status;
   volatile VALUE vpair = rb_ary_new2(2);
   rb_ary_push(vpair, MakeStatusValue(std::move(status)));
@@ -1181,24 +2819,39 @@ static VALUE dbm_set_and_get(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of DBM#remove.
 static VALUE dbm_remove(VALUE vself, VALUE vkey) {
+  ProbeScope probe("DBM#remove");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
+      if (attached.sindex != nullptr) {
+        status = RemoveIndexedRecord(sdbm, attached, key);
+        return;
+      }
       status = sdbm->dbm->Remove(key);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_REMOVE));
+  RecordTrace(sdbm, "remove", key, -1);
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, 1);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#remove_multi.
 static VALUE dbm_remove_multi(VALUE vself, VALUE vkeys) {
+  ProbeScope probe("DBM#remove_multi");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1213,22 +2866,60 @@ static VALUE dbm_remove_multi(VALUE vself, VALUE vkeys) {
     keys.emplace_back(std::string(RSTRING_PTR(vkey), RSTRING_LEN(vkey)));
   }
   std::vector<std::string_view> key_views(keys.begin(), keys.end());
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
-      status = sdbm->dbm->RemoveMulti(key_views);
-    });
+      if (attached.sindex != nullptr) {
+        for (const auto& key : key_views) {
+          status |= RemoveIndexedRecord(sdbm, attached, key);
+        }
+        return;
+      }
+      if (sdbm->shard_queue == nullptr || key_views.size() < 2) {
+        status = sdbm->dbm->RemoveMulti(key_views);
+        return;
+      }
+      const auto& groups = GroupKeysByShard(key_views, sdbm->num_shards);
+      std::vector<tkrzw::Status> group_statuses(groups.size());
+      std::vector<std::function<void(void)>> tasks;
+      for (size_t i = 0; i < groups.size(); i++) {
+        tasks.emplace_back([&, i]() {
+            group_statuses[i] = sdbm->dbm->RemoveMulti(groups[i]);
+          });
+      }
+      RunShardTasks(sdbm, tasks);
+      for (const auto& group_status : group_statuses) {
+        status |= group_status;
+      }
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_REMOVE));
+  if (sdbm->trace != nullptr) {
+    for (const auto& key : keys) {
+      RecordTrace(sdbm, "remove", key, -1);
+    }
+  }
+  for (const auto& key : keys) {
+    InvalidateReadCache(sdbm, key);
+  }
+  CountDBMUpdates(sdbm, keys.size());
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, keys.size());
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#remove_and_get.
 static VALUE dbm_remove_and_get(VALUE vself, VALUE vkey) {
+  ProbeScope probe("DBM#remove_and_get");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   tkrzw::Status impl_status(tkrzw::Status::SUCCESS);
   std::string old_value;
   class Processor final : public tkrzw::DBM::RecordProcessor {
@@ -1251,7 +2942,10 @@ static VALUE dbm_remove_and_get(VALUE vself, VALUE vkey) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Process(key, &proc, true);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_REMOVE));
+  RecordTrace(sdbm, "remove", key, -1);
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
   status |= impl_status;
   volatile VALUE vpair = rb_ary_new2(2);
   rb_ary_push(vpair, MakeStatusValue(std::move(status)));
@@ -1265,8 +2959,9 @@ static VALUE dbm_remove_and_get(VALUE vself, VALUE vkey) {
 
 // Implementation of DBM#append.
 static VALUE dbm_append(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#append");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1274,24 +2969,41 @@ static VALUE dbm_append(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "21", &vkey, &vvalue, &vdelim);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   vdelim = StringValueEx(vdelim);
   const std::string_view delim = GetStringView(vdelim);
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
+  AddToBloomFilter(sdbm, key);
   NativeFunction(sdbm->concurrent, [&]() {
+      if (attached.sindex != nullptr) {
+        status = AppendIndexedRecord(sdbm, attached, key, value, delim);
+        return;
+      }
       status = sdbm->dbm->Append(key, value, delim);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SET));
+  RecordTrace(sdbm, "append", key, value.size());
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, 1);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#append_multi.
 static VALUE dbm_append_multi(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#append_multi");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   volatile VALUE vdelim, vrecords;
   rb_scan_args(argc, argv, "02", &vdelim, &vrecords);
   std::string_view delim = "";
@@ -1306,22 +3018,38 @@ static VALUE dbm_append_multi(int argc, VALUE* argv, VALUE vself) {
     record_views.emplace(std::make_pair(
         std::string_view(record.first), std::string_view(record.second)));
   }
+  for (const auto& record : record_views) {
+    AddToBloomFilter(sdbm, record.first);
+  }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->AppendMulti(record_views, delim);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SET));
+  if (sdbm->trace != nullptr) {
+    for (const auto& record : records) {
+      RecordTrace(sdbm, "append", record.first, record.second.size());
+    }
+  }
+  for (const auto& record : records) {
+    InvalidateReadCache(sdbm, record.first);
+  }
+  CountDBMUpdates(sdbm, records.size());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#compare_exchange.
 static VALUE dbm_compare_exchange(VALUE vself, VALUE vkey, VALUE vexpected, VALUE vdesired) {
+  ProbeScope probe("DBM#compare_exchange");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   std::string_view expected;
   if (vexpected != Qnil) {
     if (vexpected == obj_dbm_any_data) {
@@ -1341,22 +3069,33 @@ static VALUE dbm_compare_exchange(VALUE vself, VALUE vkey, VALUE vexpected, VALU
     }
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
+  if (vdesired != Qnil) {
+    AddToBloomFilter(sdbm, key);
+  }
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->CompareExchange(key, expected, desired);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  RecordTrace(sdbm, "compare_exchange", key,
+              vdesired == Qnil ? -1 : static_cast<int64_t>(desired.size()));
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#compare_exchange_and_get.
 static VALUE dbm_compare_exchange_and_get(
     VALUE vself, VALUE vkey, VALUE vexpected, VALUE vdesired) {
+  ProbeScope probe("DBM#compare_exchange_and_get");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   std::string_view expected;
   if (vexpected != Qnil) {
     if (vexpected == obj_dbm_any_data) {
@@ -1378,9 +3117,16 @@ static VALUE dbm_compare_exchange_and_get(
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   std::string actual;
   bool found = false;
+  if (vdesired != Qnil) {
+    AddToBloomFilter(sdbm, key);
+  }
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->CompareExchange(key, expected, desired, &actual, &found);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  RecordTrace(sdbm, "compare_exchange", key,
+              vdesired == Qnil ? -1 : static_cast<int64_t>(desired.size()));
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
   volatile VALUE vpair = rb_ary_new2(2);
   rb_ary_push(vpair, MakeStatusValue(std::move(status)));
   if (found) {
@@ -1393,22 +3139,30 @@ static VALUE dbm_compare_exchange_and_get(
 
 // Implementation of DBM#increment.
 static VALUE dbm_increment(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#increment");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   volatile VALUE vkey, vinc, vinit, vstatus;
   rb_scan_args(argc, argv, "13", &vkey, &vinc, &vinit, &vstatus);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const int64_t inc = vinc == Qnil ? 1 : GetInteger(vinc);
   const int64_t init = vinit == Qnil ? 0 : GetInteger(vinit);
   int64_t current = 0;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
+  AddToBloomFilter(sdbm, key);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Increment(key, inc, &current, init);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  RecordTrace(sdbm, "increment", key, -1);
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
@@ -1420,11 +3174,13 @@ static VALUE dbm_increment(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of DBM#process_multi.
 static VALUE dbm_process_multi(VALUE vself, VALUE vkeys, VALUE vwritable) {
+  ProbeScope probe("DBM#process_multi");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   if (sdbm->concurrent) {
     rb_raise(rb_eRuntimeError, "the concurrent mode is not supported");
   }
@@ -1473,68 +3229,120 @@ static VALUE dbm_process_multi(VALUE vself, VALUE vkeys, VALUE vwritable) {
   for (const auto& key : keys) {
     kfpairs.emplace_back(std::make_pair(std::string_view(key), func));
   }
+  if (writable) {
+    for (const auto& key : keys) {
+      AddToBloomFilter(sdbm, key);
+    }
+  }
+  LatencyTimer timer(GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
   tkrzw::Status status = sdbm->dbm->ProcessMulti(kfpairs, writable);
+  if (sdbm->trace != nullptr) {
+    for (const auto& key : keys) {
+      RecordTrace(sdbm, "process", key, -1);
+    }
+  }
+  if (writable) {
+    for (const auto& key : keys) {
+      InvalidateReadCache(sdbm, key);
+    }
+    CountDBMUpdates(sdbm, keys.size());
+  }
   if (block_error && status.IsOK()) {
     status.Set(tkrzw::Status::UNKNOWN_ERROR, "exception from the block code");
   }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#compare_exchange_multi.
 static VALUE dbm_compare_exchange_multi(VALUE vself, VALUE vexpected, VALUE vdesired) {
+  ProbeScope probe("DBM#compare_exchange_multi");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   if (TYPE(vexpected) != T_ARRAY || TYPE(vdesired) != T_ARRAY) {
     rb_raise(rb_eRuntimeError, "expected or desired is not an array");
   }
   const auto& expected = ExtractSVPairs(vexpected);
   const auto& desired = ExtractSVPairs(vdesired);
+  for (const auto& record : desired) {
+    AddToBloomFilter(sdbm, record.first);
+  }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->CompareExchangeMulti(expected, desired);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  if (sdbm->trace != nullptr) {
+    for (const auto& record : desired) {
+      RecordTrace(sdbm, "compare_exchange", record.first, record.second.data() == nullptr ?
+                  -1 : static_cast<int64_t>(record.second.size()));
+    }
+  }
+  for (const auto& record : desired) {
+    InvalidateReadCache(sdbm, record.first);
+  }
+  CountDBMUpdates(sdbm, 1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#rekey.
 static VALUE dbm_rekey(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#rekey");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   volatile VALUE vold_key, vnew_key, voverwrite, vcopying;
   rb_scan_args(argc, argv, "22", &vold_key, &vnew_key, &voverwrite);
   vold_key = StringValueEx(vold_key);
   const std::string_view old_key = GetStringView(vold_key);
+  probe.SetKeySize(old_key.size());
   vnew_key = StringValueEx(vnew_key);
   const std::string_view new_key = GetStringView(vnew_key);
   const bool overwrite = argc > 2 ? RTEST(voverwrite) : true;
   const bool copying = argc > 3 ? RTEST(vcopying) : false;
+  AddToBloomFilter(sdbm, new_key);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Rekey(old_key, new_key, overwrite, copying);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  // The new key is recorded in the following line, as a line has only one key.
+  RecordTrace(sdbm, "rekey", old_key, -1);
+  RecordTrace(sdbm, "rekey_to", new_key, -1);
+  InvalidateReadCache(sdbm, old_key);
+  InvalidateReadCache(sdbm, new_key);
+  CountDBMUpdates(sdbm, 1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#pop_first.
 static VALUE dbm_pop_first(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#pop_first");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   volatile VALUE vstatus;
   rb_scan_args(argc, argv, "01", &vstatus);
   std::string key, value;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->PopFirst(&key, &value);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  RecordTrace(sdbm, "pop_first", key,
+              status == tkrzw::Status::SUCCESS ? static_cast<int64_t>(value.size()) : -1);
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
@@ -1549,27 +3357,39 @@ static VALUE dbm_pop_first(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of DBM#push_last.
 static VALUE dbm_push_last(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#push_last");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   volatile VALUE vvalue, vwtime;
   rb_scan_args(argc, argv, "11", &vvalue, &vwtime);
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   const double wtime = vwtime == Qnil ? -1.0 : GetFloat(vwtime);
+  std::string key;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
-      status = sdbm->dbm->PushLast(value, wtime);
-    });
+      status = sdbm->dbm->PushLast(value, wtime, &key);
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_PROCESS));
+  RecordTrace(sdbm, "push_last", key, value.size());
+  // The key is generated by the database, so it is added to the Bloom filter afterward.
+  if (status == tkrzw::Status::SUCCESS) {
+    AddToBloomFilter(sdbm, key);
+  }
+  CountDBMUpdates(sdbm, 1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#process_each.
 static VALUE dbm_process_each(VALUE vself, VALUE vwritable) {
+  ProbeScope probe("DBM#process_each");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1578,6 +3398,10 @@ static VALUE dbm_process_each(VALUE vself, VALUE vwritable) {
   }
   rb_need_block();
   const bool writable = RTEST(vwritable);
+  if (writable) {
+    CheckNoAttachedIndex(sdbm);
+  }
+  RecordTrace(sdbm, "process_each", "", -1);
   std::string rvph;
   bool block_error = false;
   auto func = [&](std::string_view reckey, std::string_view recvalue) -> std::string_view {
@@ -1606,24 +3430,31 @@ static VALUE dbm_process_each(VALUE vself, VALUE vwritable) {
     }
     return rv;
   };
+  LatencyTimer timer(GetLatencyHistogram(sdbm->latency_stats.get(), OP_ITERATE));
   tkrzw::Status status = sdbm->dbm->ProcessEach(func, writable);
   if (block_error && status.IsOK()) {
     status.Set(tkrzw::Status::UNKNOWN_ERROR, "exception from the block code");
   }
+  if (writable) {
+    ClearReadCache(sdbm);
+    AdjustDBMMemoryUsage(sdbm);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#count.
 static VALUE dbm_count(VALUE vself) {
+  ProbeScope probe("DBM#count");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   int64_t count = 0;
   NativeFunction(sdbm->concurrent, [&]() {
       count = sdbm->dbm->CountSimple();
-    });
+    }, sdbm->gvl_stats.get());
   if (count >= 0) {
     return LL2NUM(count);
   }
@@ -1632,15 +3463,16 @@ static VALUE dbm_count(VALUE vself) {
 
 // Implementation of DBM#file_size.
 static VALUE dbm_file_size(VALUE vself) {
+  ProbeScope probe("DBM#file_size");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   int64_t file_size = 0;
   NativeFunction(sdbm->concurrent, [&]() {
       file_size = sdbm->dbm->GetFileSizeSimple();
-    });
+    }, sdbm->gvl_stats.get());
   if (file_size >= 0) {
     return LL2NUM(file_size);
   }
@@ -1649,8 +3481,9 @@ static VALUE dbm_file_size(VALUE vself) {
 
 // Implementation of DBM#file_path.
 static VALUE dbm_file_path(VALUE vself) {
+  ProbeScope probe("DBM#file_path");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1658,7 +3491,7 @@ static VALUE dbm_file_path(VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->GetFilePath(&path);
-    });
+    }, sdbm->gvl_stats.get());
   if (status == tkrzw::Status::SUCCESS) {
     return rb_str_new(path.data(), path.size());
   }
@@ -1667,15 +3500,16 @@ static VALUE dbm_file_path(VALUE vself) {
 
 // Implementation of DBM#timestamp.
 static VALUE dbm_timestamp(VALUE vself) {
+  ProbeScope probe("DBM#timestamp");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   double timestamp = 0;
   NativeFunction(sdbm->concurrent, [&]() {
       timestamp = sdbm->dbm->GetTimestampSimple();
-    });
+    }, sdbm->gvl_stats.get());
   if (timestamp >= 0) {
     return rb_float_new(timestamp);
   }
@@ -1684,22 +3518,29 @@ static VALUE dbm_timestamp(VALUE vself) {
 
 // Implementation of DBM#clear.
 static VALUE dbm_clear(VALUE vself) {
+  ProbeScope probe("DBM#clear");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Clear();
-    });
+    }, sdbm->gvl_stats.get());
+  RecordTrace(sdbm, "clear", "", -1);
+  ClearReadCache(sdbm);
+  AdjustDBMMemoryUsage(sdbm);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#rebuild.
 static VALUE dbm_rebuild(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#rebuild");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1709,28 +3550,32 @@ static VALUE dbm_rebuild(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->RebuildAdvanced(params);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_REBUILD));
+  AdjustDBMMemoryUsage(sdbm);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#should_be_rebuilt?.
 static VALUE dbm_should_be_rebuilt(VALUE vself) {
+  ProbeScope probe("DBM#should_be_rebuilt?");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   bool tobe = false;
   NativeFunction(sdbm->concurrent, [&]() {
       tobe = sdbm->dbm->ShouldBeRebuiltSimple();
-    });
+    }, sdbm->gvl_stats.get());
   return tobe ? Qtrue : Qfalse;
 }
 
 // Implementation of DBM#synchronize.
 static VALUE dbm_synchronize(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#synchronize");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1741,14 +3586,16 @@ static VALUE dbm_synchronize(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->SynchronizeAdvanced(hard, nullptr, params);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SYNCHRONIZE));
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#copy_file_data.
 static VALUE dbm_copy_file_data(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#copy_file_data");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1760,14 +3607,16 @@ static VALUE dbm_copy_file_data(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->CopyFileData(std::string(dest_path), sync_hard);
-    });
+    }, sdbm->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#export.
 static VALUE dbm_export(VALUE vself, VALUE vdestdbm) {
+  ProbeScope probe("DBM#export");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1775,85 +3624,105 @@ static VALUE dbm_export(VALUE vself, VALUE vdestdbm) {
     return MakeStatusValue(tkrzw::Status(tkrzw::Status::INVALID_ARGUMENT_ERROR));
   }
   StructDBM* sdest_dbm = nullptr;
-  Data_Get_Struct(vdestdbm, StructDBM, sdest_dbm);
+  TypedData_Get_Struct(vdestdbm, StructDBM, &type_dbm, sdest_dbm);
   if (sdest_dbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdest_dbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = sdbm->dbm->Export(sdest_dbm->dbm.get());
-    });
+    }, sdbm->gvl_stats.get());
+  ClearReadCache(sdest_dbm);
+  if (sdest_dbm->bloom_filter != nullptr) {
+    status |= AddAllKeysToBloomFilter(sdest_dbm, sdest_dbm->bloom_filter.get());
+  }
+  AdjustDBMMemoryUsage(sdest_dbm);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#export_to_flat_records.
 static VALUE dbm_export_to_flat_records(VALUE vself, VALUE vdest_file) {
+  ProbeScope probe("DBM#export_to_flat_records");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   StructFile* sdest_file = nullptr;
-  Data_Get_Struct(vdest_file, StructFile, sdest_file);
+  TypedData_Get_Struct(vdest_file, StructFile, &type_file, sdest_file);
   if (sdest_file->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = tkrzw::ExportDBMToFlatRecords(sdbm->dbm.get(), sdest_file->file.get());
-    });
+    }, sdbm->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#import_from_flat_records.
 static VALUE dbm_import_from_flat_records(VALUE vself, VALUE vsrc_file) {
+  ProbeScope probe("DBM#import_from_flat_records");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
   StructFile* ssrc_file = nullptr;
-  Data_Get_Struct(vsrc_file, StructFile, ssrc_file);
+  TypedData_Get_Struct(vsrc_file, StructFile, &type_file, ssrc_file);
   if (ssrc_file->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = tkrzw::ImportDBMFromFlatRecords(sdbm->dbm.get(), ssrc_file->file.get());
-    });
+    }, sdbm->gvl_stats.get());
+  ClearReadCache(sdbm);
+  if (sdbm->bloom_filter != nullptr) {
+    status |= AddAllKeysToBloomFilter(sdbm, sdbm->bloom_filter.get());
+  }
+  AdjustDBMMemoryUsage(sdbm);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#export_keys_as_lines.
 static VALUE dbm_export_keys_as_lines(VALUE vself, VALUE vdest_file) {
+  ProbeScope probe("DBM#export_keys_as_lines");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   StructFile* sdest_file = nullptr;
-  Data_Get_Struct(vdest_file, StructFile, sdest_file);
+  TypedData_Get_Struct(vdest_file, StructFile, &type_file, sdest_file);
   if (sdest_file->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = tkrzw::ExportDBMKeysAsLines(sdbm->dbm.get(), sdest_file->file.get());
-    });
+    }, sdbm->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#inspect_details.
 static VALUE dbm_inspect_details(VALUE vself) {
+  ProbeScope probe("DBM#inspect_details");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   std::vector<std::pair<std::string, std::string>> records;
   NativeFunction(sdbm->concurrent, [&]() {
       records = sdbm->dbm->Inspect();
-    });
+    }, sdbm->gvl_stats.get());
   volatile VALUE vhash = rb_hash_new();
   for (const auto& record : records) {
     volatile VALUE vkey = rb_str_new(record.first.data(), record.first.size());
@@ -1863,17 +3732,105 @@ static VALUE dbm_inspect_details(VALUE vself) {
   return vhash;
 }
 
+// Makes a typed object from a value of the inspection.
+static VALUE MakeMetricValue(std::string_view value) {
+  if (value == "true") {
+    return Qtrue;
+  }
+  if (value == "false") {
+    return Qfalse;
+  }
+  size_t pos = value.size() > 1 && value.front() == '-' ? 1 : 0;
+  const size_t num_start = pos;
+  bool dot = false;
+  bool exp = false;
+  while (pos < value.size()) {
+    const int32_t c = value[pos];
+    if (c >= '0' && c <= '9') {
+    } else if (c == '.' && !dot && !exp && pos > num_start) {
+      dot = true;
+    } else if ((c == 'e' || c == 'E') && !exp && pos > num_start) {
+      exp = true;
+      if (pos + 1 < value.size() && (value[pos + 1] == '+' || value[pos + 1] == '-')) {
+        pos++;
+      }
+    } else {
+      break;
+    }
+    pos++;
+  }
+  if (pos > num_start && pos == value.size() && value.back() >= '0' && value.back() <= '9') {
+    if (dot || exp) {
+      return DBL2NUM(tkrzw::StrToDouble(value));
+    }
+    return LL2NUM(tkrzw::StrToInt(value));
+  }
+  return rb_str_new(value.data(), value.size());
+}
+
+// Implementation of DBM#metrics.
+static VALUE dbm_metrics(VALUE vself) {
+  ProbeScope probe("DBM#metrics");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  std::vector<std::pair<std::string, std::string>> records;
+  int64_t num_records = -1;
+  int64_t file_size = -1;
+  NativeFunction(sdbm->concurrent, [&]() {
+      records = sdbm->dbm->Inspect();
+      num_records = sdbm->dbm->CountSimple();
+      file_size = sdbm->dbm->GetFileSizeSimple();
+    }, sdbm->gvl_stats.get());
+  volatile VALUE vhash = rb_hash_new();
+  int64_t eff_data_size = -1;
+  for (const auto& record : records) {
+    if (record.first == "eff_data_size") {
+      eff_data_size = tkrzw::StrToInt(record.second, -1);
+    }
+    volatile VALUE vkey = rb_str_new(record.first.data(), record.first.size());
+    rb_hash_aset(vhash, vkey, MakeMetricValue(record.second));
+  }
+  if (num_records >= 0) {
+    rb_hash_aset(vhash, rb_str_new2("num_records"), LL2NUM(num_records));
+  }
+  if (file_size >= 0) {
+    rb_hash_aset(vhash, rb_str_new2("file_size"), LL2NUM(file_size));
+  }
+  if (eff_data_size >= 0 && file_size > 0) {
+    const double fragmentation = std::max(0.0, 1.0 - eff_data_size / (double)file_size);
+    rb_hash_aset(vhash, rb_str_new2("fragmentation"), DBL2NUM(fragmentation));
+  }
+  if (sdbm->read_cache != nullptr) {
+    rb_hash_aset(vhash, rb_str_new2("read_cache_hits"),
+                 LL2NUM(sdbm->read_cache->GetNumHits()));
+    rb_hash_aset(vhash, rb_str_new2("read_cache_misses"),
+                 LL2NUM(sdbm->read_cache->GetNumMisses()));
+  }
+  if (sdbm->bloom_filter != nullptr) {
+    rb_hash_aset(vhash, rb_str_new2("bloom_filter_lookups"),
+                 LL2NUM(sdbm->bloom_filter->GetNumLookups()));
+    rb_hash_aset(vhash, rb_str_new2("bloom_filter_negatives"),
+                 LL2NUM(sdbm->bloom_filter->GetNumNegatives()));
+  }
+  return vhash;
+}
+
 // Implementation of DBM#open?.
 static VALUE dbm_is_open(VALUE vself) {
+  ProbeScope probe("DBM#open?");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   return sdbm->dbm == nullptr ? Qfalse : Qtrue;
 }
 
 // Implementation of DBM#writable?.
 static VALUE dbm_is_writable(VALUE vself) {
+  ProbeScope probe("DBM#writable?");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1883,8 +3840,9 @@ static VALUE dbm_is_writable(VALUE vself) {
 
 // Implementation of DBM#healthy?.
 static VALUE dbm_is_healthy(VALUE vself) {
+  ProbeScope probe("DBM#healthy?");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1894,8 +3852,9 @@ static VALUE dbm_is_healthy(VALUE vself) {
 
 // Implementation of DBM#ordered?.
 static VALUE dbm_is_ordered(VALUE vself) {
+  ProbeScope probe("DBM#ordered?");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1905,8 +3864,9 @@ static VALUE dbm_is_ordered(VALUE vself) {
 
 // Implementation of DBM#search.
 static VALUE dbm_search(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#search");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -1921,7 +3881,7 @@ static VALUE dbm_search(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
       status = tkrzw::SearchDBMModal(sdbm->dbm.get(), mode, pattern, &keys, capacity);
-    });
+    }, sdbm->gvl_stats.get());
   if (status != tkrzw::Status::SUCCESS) {
     const std::string& message = tkrzw::ToString(status);
     rb_raise(cls_expt, "%s", message.c_str());
@@ -1935,11 +3895,13 @@ static VALUE dbm_search(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of DBM#make_iterator.
 static VALUE dbm_make_iterator(VALUE vself) {
+  ProbeScope probe("DBM#make_iterator");
   return rb_class_new_instance(1, &vself, cls_iter);
 }
 
 // Implementation of DBM.restore_database.
 static VALUE dbm_restore_database(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM.restore_database");
   volatile VALUE vold_file_path, vnew_file_path, vclass_name, vend_offset, vcipher_key;
   rb_scan_args(argc, argv, "23", &vold_file_path, &vnew_file_path,
                &vclass_name, &vend_offset, &vcipher_key);
@@ -1964,13 +3926,15 @@ static VALUE dbm_restore_database(int argc, VALUE* argv, VALUE vself) {
           std::string(class_name), end_offset, cipher_key);
     });
   }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#to_s.
 static VALUE dbm_to_s(VALUE vself) {
+  ProbeScope probe("DBM#to_s");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }  
@@ -1986,7 +3950,7 @@ static VALUE dbm_to_s(VALUE vself) {
         }
       }
       count = sdbm->dbm->CountSimple();
-    });
+    }, sdbm->gvl_stats.get());
   const std::string expr =
       tkrzw::StrCat(class_name, ":", tkrzw::StrEscapeC(path, true), ":", count);
   return rb_str_new(expr.data(), expr.size());
@@ -1994,22 +3958,24 @@ static VALUE dbm_to_s(VALUE vself) {
 
 // Implementation of DBM#to_i.
 static VALUE dbm_to_i(VALUE vself) {
+  ProbeScope probe("DBM#to_i");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   int64_t count = -1;
   NativeFunction(sdbm->concurrent, [&]() {
       count = sdbm->dbm->CountSimple();
-    });
+    }, sdbm->gvl_stats.get());
   return LL2NUM(count);
 }
 
 // Implementation of DBM#inspect.
 static VALUE dbm_inspect(VALUE vself) {
+  ProbeScope probe("DBM#inspect");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     return rb_str_new2("#<Tkrzw::DBM:(not opened database)>");
   }
@@ -2025,7 +3991,7 @@ static VALUE dbm_inspect(VALUE vself) {
         }
       }
       count = sdbm->dbm->CountSimple();
-    });
+    }, sdbm->gvl_stats.get());
   const std::string expr = tkrzw::StrCat(
       "#<Tkrzw::DBM:", class_name, ":", tkrzw::StrEscapeC(path, true), ":", count, ">");
   return rb_str_new(expr.data(), expr.size());
@@ -2033,51 +3999,71 @@ static VALUE dbm_inspect(VALUE vself) {
 
 // Implementation of DBM#[].
 static VALUE dbm_ss_get(VALUE vself, VALUE vkey) {
+  ProbeScope probe("DBM#[]");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   std::string value;
-  tkrzw::Status status(tkrzw::Status::SUCCESS);
-  NativeFunction(sdbm->concurrent, [&]() {
-      status = sdbm->dbm->Get(key, &value);
-    });
+  tkrzw::Status status = MayContainKey(sdbm, key) ?
+      GetWithReadCache(sdbm, key, &value) : tkrzw::Status(tkrzw::Status::NOT_FOUND_ERROR);
+  RecordTrace(sdbm, "get", key,
+              status == tkrzw::Status::SUCCESS ? static_cast<int64_t>(value.size()) : -1);
   if (status == tkrzw::Status::SUCCESS) {
-    return MakeString(value, sdbm->venc);
+    probe.SetValueSize(value.size());
+    return MakeValueString(value, sdbm->venc, sdbm->max_interned_size);
   }
   return Qnil;
 }
 
 // Implementation of DBM#[]=.
 static VALUE dbm_ss_set(VALUE vself, VALUE vkey, VALUE vvalue) {
+  ProbeScope probe("DBM#[]=");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
+  AddToBloomFilter(sdbm, key);
   NativeFunction(sdbm->concurrent, [&]() {
+      if (attached.sindex != nullptr) {
+        status = SetIndexedRecord(sdbm, attached, key, value, true);
+        return;
+      }
       status = sdbm->dbm->Set(key, value);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_SET));
+  RecordTrace(sdbm, "set", key, value.size());
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, 1);
+  }
   return vvalue;
 }
 
 // Implementation of DBM#delete.
 static VALUE dbm_delete(VALUE vself, VALUE vkey) {
+  ProbeScope probe("DBM#delete");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   tkrzw::Status impl_status(tkrzw::Status::SUCCESS);
   std::string old_value;
   class Processor final : public tkrzw::DBM::RecordProcessor {
@@ -2097,10 +4083,25 @@ static VALUE dbm_delete(VALUE vself, VALUE vkey) {
     std::string* old_value_;
   };
   Processor proc(&impl_status, &old_value);
+  const AttachedIndex attached = GetAttachedIndex(sdbm);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sdbm->concurrent, [&]() {
+      if (attached.sindex != nullptr) {
+        status = ProcessIndexedRecord(
+            sdbm, attached, key, [&](std::string_view reckey, std::string_view recvalue) {
+              return recvalue.data() == tkrzw::DBM::RecordProcessor::NOOP.data() ?
+                  proc.ProcessEmpty(reckey) : proc.ProcessFull(reckey, recvalue);
+            });
+        return;
+      }
       status = sdbm->dbm->Process(key, &proc, true);
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_REMOVE));
+  RecordTrace(sdbm, "remove", key, -1);
+  InvalidateReadCache(sdbm, key);
+  CountDBMUpdates(sdbm, 1);
+  if (attached.sindex != nullptr) {
+    CountIndexUpdates(attached.sindex, 1);
+  }
   status |= impl_status;
   if (status != tkrzw::Status::SUCCESS) {
     return Qnil;
@@ -2110,30 +4111,33 @@ static VALUE dbm_delete(VALUE vself, VALUE vkey) {
 
 // Implementation of DBM#each.
 static VALUE dbm_each(VALUE vself) {
+  ProbeScope probe("DBM#each");
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vself, StructDBM, sdbm);
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   if (!rb_block_given_p()) {
     rb_raise(rb_eArgError, "block is not given");
   }
+  RecordTrace(sdbm, "each", "", -1);
   std::unique_ptr<tkrzw::DBM::Iterator> iter;
   NativeFunction(sdbm->concurrent, [&]() {
       iter = sdbm->dbm->MakeIterator();
       iter->First();
-    });
+    }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_ITERATE));
   while (true) {
     std::string key, value;
     tkrzw::Status status(tkrzw::Status::SUCCESS);
     NativeFunction(sdbm->concurrent, [&]() {
         status = iter->Get(&key, &value);
-      });
+      }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_ITERATE));
     if (status != tkrzw::Status::SUCCESS) {
       break;
     }
     volatile VALUE args =
-        rb_ary_new3(2, MakeString(key, sdbm->venc), MakeString(value, sdbm->venc));
+        rb_ary_new3(2, MakeString(key, sdbm->venc),
+                    MakeValueString(value, sdbm->venc, sdbm->max_interned_size));
     int result = 0;
     rb_protect(YieldToBlock, args, &result);
     if (result != 0) {
@@ -2142,7 +4146,326 @@ static VALUE dbm_each(VALUE vself) {
     }
     NativeFunction(sdbm->concurrent, [&]() {
         iter->Next();
-      });
+      }, sdbm->gvl_stats.get(), GetLatencyHistogram(sdbm->latency_stats.get(), OP_ITERATE));
+  }
+  return Qnil;
+}
+
+// Implementation of DBM#parallel_each.
+static VALUE dbm_parallel_each(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("DBM#parallel_each");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  volatile VALUE vparams;
+  rb_scan_args(argc, argv, "01", &vparams);
+  const std::map<std::string, std::string> params = HashToMap(vparams);
+  const bool with_block = rb_block_given_p();
+  RecordTrace(sdbm, "parallel_each", "", -1);
+  std::vector<std::string> shard_paths;
+  if (sdbm->num_shards > 1 && !sdbm->open_writable && !sdbm->open_path.empty()) {
+    for (int32_t i = 0; i < sdbm->num_shards; i++) {
+      shard_paths.emplace_back(tkrzw::SPrintF(
+          "%s-%05d-of-%05d", sdbm->open_path.c_str(), i, sdbm->num_shards));
+    }
+  }
+  const int32_t num_units = std::max<int32_t>(shard_paths.size(), 1);
+  const int32_t num_requested = tkrzw::StrToInt(
+      tkrzw::SearchMap(params, "threads", tkrzw::ToString(num_units)));
+  const int32_t num_threads = std::max<int32_t>(std::min<int32_t>(num_requested, num_units), 1);
+  const size_t batch_size = std::max<int64_t>(
+      tkrzw::StrToInt(tkrzw::SearchMap(params, "batch_size", "1000")), 1);
+  std::map<std::string, std::string> shard_params = sdbm->open_params;
+  shard_params.erase("num_shards");
+  RecordBatchQueue queue(num_threads * 2, num_threads);
+  std::atomic_int32_t next_unit(0);
+  std::mutex mutex;
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  if (num_requested > 1 && num_units < 2) {
+    status.Set(tkrzw::Status::INFEASIBLE_ERROR,
+               "parallel scan needs a sharded database opened as read-only");
+  }
+  int64_t count = 0;
+  int64_t key_size = 0;
+  int64_t value_size = 0;
+  double value_sum = 0;
+  auto scan = [&]() {
+    tkrzw::Status scan_status(tkrzw::Status::SUCCESS);
+    int64_t scan_count = 0;
+    int64_t scan_key_size = 0;
+    int64_t scan_value_size = 0;
+    double scan_value_sum = 0;
+    RecordBatchQueue::Batch batch;
+    bool canceled = false;
+    while (!canceled) {
+      const int32_t unit = next_unit++;
+      if (unit >= num_units) {
+        break;
+      }
+      tkrzw::PolyDBM shard_dbm;
+      tkrzw::DBM* dbm = sdbm->dbm.get();
+      if (!shard_paths.empty()) {
+        const tkrzw::Status open_status = shard_dbm.OpenAdvanced(
+            shard_paths[unit], false, sdbm->open_options | tkrzw::File::OPEN_NO_LOCK,
+            shard_params);
+        if (open_status != tkrzw::Status::SUCCESS) {
+          scan_status |= open_status;
+          continue;
+        }
+        dbm = &shard_dbm;
+      }
+      auto iter = dbm->MakeIterator();
+      tkrzw::Status iter_status = iter->First();
+      std::string key, value;
+      while (iter_status == tkrzw::Status::SUCCESS) {
+        iter_status = iter->Step(&key, &value);
+        if (iter_status != tkrzw::Status::SUCCESS) {
+          break;
+        }
+        if (with_block) {
+          batch.emplace_back(std::make_pair(std::move(key), std::move(value)));
+          if (batch.size() >= batch_size) {
+            if (!queue.Push(std::move(batch))) {
+              canceled = true;
+              break;
+            }
+            batch.clear();
+          }
+        } else {
+          scan_count++;
+          scan_key_size += key.size();
+          scan_value_size += value.size();
+          scan_value_sum += tkrzw::StrToDouble(value, 0.0);
+          if (scan_count % batch_size == 0 && queue.IsCanceled()) {
+            canceled = true;
+            break;
+          }
+        }
+      }
+      if (iter_status != tkrzw::Status::NOT_FOUND_ERROR) {
+        scan_status |= iter_status;
+      }
+      if (!shard_paths.empty()) {
+        scan_status |= shard_dbm.Close();
+      }
+    }
+    if (!batch.empty() && !canceled) {
+      queue.Push(std::move(batch));
+    }
+    queue.FinishProducer();
+    std::lock_guard<std::mutex> lock(mutex);
+    status |= scan_status;
+    count += scan_count;
+    key_size += scan_key_size;
+    value_size += scan_value_size;
+    value_sum += scan_value_sum;
+  };
+  std::vector<std::thread> threads;
+  if (status == tkrzw::Status::SUCCESS) {
+    tkrzw::Status start_status = StartNativeThreads(&threads, num_threads, scan, &queue);
+    if (start_status != tkrzw::Status::SUCCESS) {
+      status = std::move(start_status);
+    }
+  } else {
+    queue.Cancel();
+  }
+  int result = 0;
+  if (with_block) {
+    while (true) {
+      RecordBatchPopper popper;
+      popper.queue = &queue;
+      rb_thread_call_without_gvl(PopRecordBatch, &popper, CancelRecordBatchQueue, &queue);
+      if (!popper.popped) {
+        break;
+      }
+      volatile VALUE vbatch = rb_ary_new2(popper.batch.size());
+      for (const auto& record : popper.batch) {
+        rb_ary_push(vbatch, rb_ary_new3(2, MakeString(record.first, sdbm->venc),
+                                        MakeValueString(record.second, sdbm->venc,
+                                                        sdbm->max_interned_size)));
+      }
+      rb_protect(YieldToBlock, vbatch, &result);
+      if (result != 0) {
+        queue.Cancel();
+        break;
+      }
+    }
+  }
+  rb_thread_call_without_gvl(JoinNativeThreads, &threads, CancelRecordBatchQueue, &queue);
+  if (result != 0) {
+    rb_jump_tag(result);
+  }
+  rb_thread_check_ints();
+  if (with_block) {
+    probe.SetStatus(status);
+    return MakeStatusValue(std::move(status));
+  }
+  volatile VALUE vstats = rb_hash_new();
+  rb_hash_aset(vstats, rb_str_new2("count"), LL2NUM(count));
+  rb_hash_aset(vstats, rb_str_new2("key_size"), LL2NUM(key_size));
+  rb_hash_aset(vstats, rb_str_new2("value_size"), LL2NUM(value_size));
+  rb_hash_aset(vstats, rb_str_new2("value_sum"), DBL2NUM(value_sum));
+  volatile VALUE vpair = rb_ary_new2(2);
+  rb_ary_push(vpair, MakeStatusValue(std::move(status)));
+  rb_ary_push(vpair, vstats);
+  return vpair;
+}
+
+// Implementation of DBM#after_fork.
+static VALUE dbm_after_fork(VALUE vself) {
+  ProbeScope probe("DBM#after_fork");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  tkrzw::Status status = ReopenDBMAfterFork(sdbm);
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of Process._fork overridden by ForkHook.
+static VALUE forkhook_fork(VALUE vself) {
+  volatile VALUE vpid = rb_call_super(0, nullptr);
+  if (vpid == INT2FIX(0)) {
+    const std::set<StructDBM*> sdbms = dbms_to_reopen_on_fork;
+    for (auto* sdbm : sdbms) {
+      if (sdbm->dbm != nullptr) {
+        ReopenDBMAfterFork(sdbm);
+      }
+    }
+  }
+  return vpid;
+}
+
+// Implementation of DBM#record_trace.
+static VALUE dbm_record_trace(VALUE vself, VALUE vpath) {
+  ProbeScope probe("DBM#record_trace");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  if (sdbm->trace != nullptr) {
+    status = sdbm->trace->Close();
+    sdbm->trace.reset(nullptr);
+  }
+  if (vpath != Qnil) {
+    vpath = StringValueEx(vpath);
+    const std::string_view path = GetStringView(vpath);
+    auto trace = std::make_unique<TraceRecorder>();
+    status |= trace->Open(std::string(path));
+    if (status == tkrzw::Status::SUCCESS) {
+      sdbm->trace = std::move(trace);
+    }
+  }
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of DBM#attach_index.
+static VALUE dbm_attach_index(VALUE vself, VALUE vindex, VALUE vextractor) {
+  ProbeScope probe("DBM#attach_index");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  if (!rb_obj_is_instance_of(vindex, cls_index)) {
+    rb_raise(rb_eArgError, "index is not an Index");
+  }
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vindex, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  sdbm->index_extractor = std::make_shared<IndexExtractor>(HashToMap(vextractor));
+  RB_OBJ_WRITE(vself, &sdbm->vindex, vindex);
+  return Qnil;
+}
+
+// Implementation of DBM#detach_index.
+static VALUE dbm_detach_index(VALUE vself) {
+  ProbeScope probe("DBM#detach_index");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  // Methods in progress keep their own references to the index and the extractor.
+  sdbm->vindex = Qnil;
+  sdbm->index_extractor.reset();
+  return Qnil;
+}
+
+// Implementation of DBM#stats.
+static VALUE dbm_stats(VALUE vself) {
+  ProbeScope probe("DBM#stats");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  volatile VALUE vstats = rb_hash_new();
+  rb_hash_aset(vstats, rb_str_new2("gvl"), MakeGVLStatsValue(*sdbm->gvl_stats));
+  if (sdbm->read_cache != nullptr) {
+    volatile VALUE vcache = rb_hash_new();
+    rb_hash_aset(vcache, rb_str_new2("hits"), LL2NUM(sdbm->read_cache->GetNumHits()));
+    rb_hash_aset(vcache, rb_str_new2("misses"), LL2NUM(sdbm->read_cache->GetNumMisses()));
+    rb_hash_aset(vcache, rb_str_new2("count"), LL2NUM(sdbm->read_cache->GetCount()));
+    rb_hash_aset(vcache, rb_str_new2("capacity"), LL2NUM(sdbm->read_cache->GetCapacity()));
+    rb_hash_aset(vstats, rb_str_new2("read_cache"), vcache);
+  }
+  if (sdbm->bloom_filter != nullptr) {
+    const BloomFilter& filter = *sdbm->bloom_filter;
+    volatile VALUE vfilter = rb_hash_new();
+    rb_hash_aset(vfilter, rb_str_new2("capacity"), LL2NUM(filter.GetCapacity()));
+    rb_hash_aset(vfilter, rb_str_new2("error_rate"), DBL2NUM(filter.GetErrorRate()));
+    rb_hash_aset(vfilter, rb_str_new2("num_bits"), LL2NUM(filter.GetNumBits()));
+    rb_hash_aset(vfilter, rb_str_new2("num_hashes"), INT2NUM(filter.GetNumHashes()));
+    rb_hash_aset(vfilter, rb_str_new2("lookups"), LL2NUM(filter.GetNumLookups()));
+    rb_hash_aset(vfilter, rb_str_new2("negatives"), LL2NUM(filter.GetNumNegatives()));
+    rb_hash_aset(vstats, rb_str_new2("bloom_filter"), vfilter);
+  }
+  if (sdbm->latency_stats == nullptr) {
+    return vstats;
+  }
+  for (int32_t op = 0; op < NUM_LATENCY_OPS; op++) {
+    const LatencyHistogram& hist = sdbm->latency_stats->hists[op];
+    const int64_t count = hist.GetCount();
+    volatile VALUE vhist = rb_hash_new();
+    rb_hash_aset(vhist, rb_str_new2("count"), LL2NUM(count));
+    rb_hash_aset(vhist, rb_str_new2("mean"),
+                 DBL2NUM(count > 0 ? hist.GetTotal() / 1000.0 / count : 0.0));
+    rb_hash_aset(vhist, rb_str_new2("p50"), DBL2NUM(hist.GetPercentile(0.5) / 1000.0));
+    rb_hash_aset(vhist, rb_str_new2("p90"), DBL2NUM(hist.GetPercentile(0.9) / 1000.0));
+    rb_hash_aset(vhist, rb_str_new2("p99"), DBL2NUM(hist.GetPercentile(0.99) / 1000.0));
+    rb_hash_aset(vhist, rb_str_new2("p999"), DBL2NUM(hist.GetPercentile(0.999) / 1000.0));
+    rb_hash_aset(vhist, rb_str_new2("max"), DBL2NUM(hist.GetMax() / 1000.0));
+    rb_hash_aset(vstats, rb_str_new2(LATENCY_OP_NAMES[op]), vhist);
+  }
+  return vstats;
+}
+
+// Implementation of DBM#reset_stats.
+static VALUE dbm_reset_stats(VALUE vself) {
+  ProbeScope probe("DBM#reset_stats");
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vself, StructDBM, &type_dbm, sdbm);
+  if (sdbm->dbm == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened database");
+  }
+  ResetGVLStats(sdbm->gvl_stats.get());
+  if (sdbm->read_cache != nullptr) {
+    sdbm->read_cache->ResetCounters();
+  }
+  if (sdbm->bloom_filter != nullptr) {
+    sdbm->bloom_filter->ResetCounters();
+  }
+  if (sdbm->latency_stats != nullptr) {
+    for (auto& hist : sdbm->latency_stats->hists) {
+      hist.Reset();
+    }
   }
   return Qnil;
 }
@@ -2192,6 +4515,7 @@ static void DefineDBM() {
   rb_define_method(cls_dbm, "import_from_flat_records", (METHOD)dbm_import_from_flat_records, 1);
   rb_define_method(cls_dbm, "export_keys_as_lines", (METHOD)dbm_export_keys_as_lines, 1);
   rb_define_method(cls_dbm, "inspect_details", (METHOD)dbm_inspect_details, 0);
+  rb_define_method(cls_dbm, "metrics", (METHOD)dbm_metrics, 0);
   rb_define_method(cls_dbm, "open?", (METHOD)dbm_is_open, 0);
   rb_define_method(cls_dbm, "writable?", (METHOD)dbm_is_writable, 0);
   rb_define_method(cls_dbm, "healthy?", (METHOD)dbm_is_healthy, 0);
@@ -2206,6 +4530,32 @@ static void DefineDBM() {
   rb_define_method(cls_dbm, "[]=", (METHOD)dbm_ss_set, 2);
   rb_define_method(cls_dbm, "delete", (METHOD)dbm_delete, 1);
   rb_define_method(cls_dbm, "each", (METHOD)dbm_each, 0);
+  rb_define_method(cls_dbm, "parallel_each", (METHOD)dbm_parallel_each, -1);
+  rb_define_method(cls_dbm, "after_fork", (METHOD)dbm_after_fork, 0);
+  rb_define_method(cls_dbm, "record_trace", (METHOD)dbm_record_trace, 1);
+  rb_define_method(cls_dbm, "attach_index", (METHOD)dbm_attach_index, 2);
+  rb_define_method(cls_dbm, "detach_index", (METHOD)dbm_detach_index, 0);
+  rb_define_method(cls_dbm, "stats", (METHOD)dbm_stats, 0);
+  rb_define_method(cls_dbm, "reset_stats", (METHOD)dbm_reset_stats, 0);
+  mod_fork_hook = rb_define_module_under(mod_tkrzw, "ForkHook");
+  rb_define_method(mod_fork_hook, "_fork", (METHOD)forkhook_fork, 0);
+  if (rb_respond_to(rb_mProcess, rb_intern("_fork"))) {
+    rb_prepend_module(rb_singleton_class(rb_mProcess), mod_fork_hook);
+  }
+}
+
+// Implementation of Iterator#mark.
+static void iter_mark(void* ptr) {
+  StructIter* siter = (StructIter*)ptr;
+  rb_gc_mark_movable(siter->venc);
+  rb_gc_mark_movable(siter->vdbm);
+}
+
+// Implementation of Iterator#compact.
+static void iter_compact(void* ptr) {
+  StructIter* siter = (StructIter*)ptr;
+  siter->venc = rb_gc_location(siter->venc);
+  siter->vdbm = rb_gc_location(siter->vdbm);
 }
 
 // Implementation of Iterator#del.
@@ -2215,86 +4565,109 @@ static void iter_del(void* ptr) {
   delete siter;
 }
 
+// Implementation of Iterator#memsize.
+static size_t iter_memsize(const void* ptr) {
+  return sizeof(StructIter);
+}
+
 // Implementation of Iterator.new.
 static VALUE iter_new(VALUE cls) {
   StructIter* siter = new StructIter;
-  return Data_Wrap_Struct(cls_iter, 0, iter_del, siter);
+  return TypedData_Wrap_Struct(cls_iter, &type_iter, siter);
 }
 
 // Implementation of Iterator#initialize.
 static VALUE iter_initialize(VALUE vself, VALUE vdbm) {
+  ProbeScope probe("Iterator#initialize");
   if (!rb_obj_is_instance_of(vdbm, cls_dbm)) {
     rb_raise(rb_eArgError, "#<Tkrzw::StatusException>");
   }
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vdbm, StructDBM, sdbm);
+  TypedData_Get_Struct(vdbm, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   siter->iter = sdbm->dbm->MakeIterator();
   siter->concurrent = sdbm->concurrent;
-  siter->venc = sdbm->venc;
+  RB_OBJ_WRITE(vself, &siter->venc, sdbm->venc);
+  RB_OBJ_WRITE(vself, &siter->vdbm, vdbm);
+  siter->latency_stats = sdbm->latency_stats;
+  siter->gvl_stats = sdbm->gvl_stats;
+  siter->read_cache = sdbm->read_cache;
+  siter->max_interned_size = sdbm->max_interned_size;
   return Qnil;
 }
 
 // Implementation of Iterator#destruct.
 static VALUE iter_destruct(VALUE vself) {
+  ProbeScope probe("Iterator#destruct");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   siter->iter.reset(nullptr);
   return Qnil;
 }
 
 // Implementation of Iterator#first.
 static VALUE iter_first(VALUE vself) {
+  ProbeScope probe("Iterator#first");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->First();
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_first", "", -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#last.
 static VALUE iter_last(VALUE vself) {
+  ProbeScope probe("Iterator#last");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Last();
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_last", "", -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#jump.
 static VALUE iter_jump(VALUE vself, VALUE vkey) {
+  ProbeScope probe("Iterator#jump");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Jump(key);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_jump", key, -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#jump_lower.
 static VALUE iter_jump_lower(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Iterator#jump_lower");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2302,18 +4675,22 @@ static VALUE iter_jump_lower(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vkey, &vinclusive);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const bool inclusive = argc > 1 ? RTEST(vinclusive) :false;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->JumpLower(key, inclusive);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_jump_lower", key, -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#jump_upper.
 static VALUE iter_jump_upper(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Iterator#jump_upper");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2321,46 +4698,56 @@ static VALUE iter_jump_upper(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vkey, &vinclusive);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const bool inclusive = argc > 1 ? RTEST(vinclusive) :false;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->JumpUpper(key, inclusive);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_jump_upper", key, -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#next.
 static VALUE iter_next(VALUE vself) {
+  ProbeScope probe("Iterator#next");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Next();
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_next", "", -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#previous.
 static VALUE iter_previous(VALUE vself) {
+  ProbeScope probe("Iterator#previous");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Previous();
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_previous", "", -1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#get.
 static VALUE iter_get(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Iterator#get");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2370,14 +4757,17 @@ static VALUE iter_get(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Get(&key, &value);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_get", key,
+                  status == tkrzw::Status::SUCCESS ? static_cast<int64_t>(value.size()) : -1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
   if (status == tkrzw::Status::SUCCESS) {
     volatile VALUE vary = rb_ary_new2(2);
     rb_ary_push(vary, MakeString(key, siter->venc));
-    rb_ary_push(vary, MakeString(value, siter->venc));
+    rb_ary_push(vary, MakeValueString(value, siter->venc, siter->max_interned_size));
     return vary;
   }
   return Qnil;
@@ -2385,8 +4775,9 @@ static VALUE iter_get(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of Iterator#get_key.
 static VALUE iter_get_key(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Iterator#get_key");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2396,7 +4787,9 @@ static VALUE iter_get_key(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Get(&key);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_get", key, -1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
@@ -2408,8 +4801,9 @@ static VALUE iter_get_key(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of Iterator#get_value.
 static VALUE iter_get_value(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Iterator#get_value");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2419,50 +4813,76 @@ static VALUE iter_get_value(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Get(nullptr, &value);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_get", "",
+                  status == tkrzw::Status::SUCCESS ? static_cast<int64_t>(value.size()) : -1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
   if (status == tkrzw::Status::SUCCESS) {
-    return MakeString(value, siter->venc);
+    probe.SetValueSize(value.size());
+    return MakeValueString(value, siter->venc, siter->max_interned_size);
   }
   return Qnil;
 }
 
 // Implementation of Iterator#set.
 static VALUE iter_set(VALUE vself, VALUE vvalue) {
+  ProbeScope probe("Iterator#set");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(siter->vdbm, StructDBM, &type_dbm, sdbm);
+  CheckNoAttachedIndex(sdbm);
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
+  std::string key;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
-      status = siter->iter->Set(value);
-    });
+      status = siter->iter->Set(value, &key);
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_set", key, value.size());
+  if (siter->read_cache != nullptr && status == tkrzw::Status::SUCCESS) {
+    siter->read_cache->Invalidate(key);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#remove.
 static VALUE iter_remove(VALUE vself) {
+  ProbeScope probe("Iterator#remove");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(siter->vdbm, StructDBM, &type_dbm, sdbm);
+  CheckNoAttachedIndex(sdbm);
+  std::string key;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
-      status = siter->iter->Remove();
-    });
+      status = siter->iter->Remove(&key);
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_remove", key, -1);
+  if (siter->read_cache != nullptr && status == tkrzw::Status::SUCCESS) {
+    siter->read_cache->Invalidate(key);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Iterator#step.
 static VALUE iter_step(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Iterator#step");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2472,14 +4892,17 @@ static VALUE iter_step(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Step(&key, &value);
-    });
+    }, siter->gvl_stats.get(), GetLatencyHistogram(siter->latency_stats.get(), OP_ITERATE));
+  RecordIterTrace(siter, "iterator_step", key,
+                  status == tkrzw::Status::SUCCESS ? static_cast<int64_t>(value.size()) : -1);
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
   if (status == tkrzw::Status::SUCCESS) {
     volatile VALUE vary = rb_ary_new2(2);
     rb_ary_push(vary, MakeString(key, siter->venc));
-    rb_ary_push(vary, MakeString(value, siter->venc));
+    rb_ary_push(vary, MakeValueString(value, siter->venc, siter->max_interned_size));
     return vary;
   }
   return Qnil;
@@ -2487,8 +4910,9 @@ static VALUE iter_step(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of Iterator#to_s.
 static VALUE iter_to_s(VALUE vself) {
+  ProbeScope probe("Iterator#to_s");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -2496,7 +4920,7 @@ static VALUE iter_to_s(VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Get(&key);
-    });
+    }, siter->gvl_stats.get());
   if (status  != tkrzw::Status::SUCCESS) {
     key = "(unlocated)";
   }
@@ -2506,8 +4930,9 @@ static VALUE iter_to_s(VALUE vself) {
 
 // Implementation of Iterator#inspect.
 static VALUE iter_inspect(VALUE vself) {
+  ProbeScope probe("Iterator#inspect");
   StructIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIter, siter);
+  TypedData_Get_Struct(vself, StructIter, &type_iter, siter);
   if (siter->iter == nullptr) {
     return rb_str_new2("#<Tkrzw::Iterator:(destructed object)>");
   }
@@ -2515,7 +4940,7 @@ static VALUE iter_inspect(VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(siter->concurrent, [&]() {
       status = siter->iter->Get(&key);
-    });
+    }, siter->gvl_stats.get());
   if (status != tkrzw::Status::SUCCESS) {
     key = "(unlocated)";
   }
@@ -2547,6 +4972,20 @@ static void DefineIterator() {
   rb_define_method(cls_iter, "inspect", (METHOD)iter_inspect, 0);
 }
 
+// Implementation of AsyncDBM#mark.
+static void asyncdbm_mark(void* ptr) {
+  StructAsyncDBM* sasync = (StructAsyncDBM*)ptr;
+  rb_gc_mark_movable(sasync->venc);
+  rb_gc_mark_movable(sasync->vdbm);
+}
+
+// Implementation of AsyncDBM#compact.
+static void asyncdbm_compact(void* ptr) {
+  StructAsyncDBM* sasync = (StructAsyncDBM*)ptr;
+  sasync->venc = rb_gc_location(sasync->venc);
+  sasync->vdbm = rb_gc_location(sasync->vdbm);
+}
+
 // Implementation of AsyncDBM#del.
 static void asyncdbm_del(void* ptr) {
   StructAsyncDBM* sasync = (StructAsyncDBM*)ptr;
@@ -2554,40 +4993,58 @@ static void asyncdbm_del(void* ptr) {
   delete sasync;
 }
 
+// Implementation of AsyncDBM#memsize.
+static size_t asyncdbm_memsize(const void* ptr) {
+  return sizeof(StructAsyncDBM);
+}
+
 // Implementation of AsyncDBM.new.
 static VALUE asyncdbm_new(VALUE cls) {
   StructAsyncDBM* sasync = new StructAsyncDBM;
-  return Data_Wrap_Struct(cls_asyncdbm, 0, asyncdbm_del, sasync);
+  return TypedData_Wrap_Struct(cls_asyncdbm, &type_asyncdbm, sasync);
 }
 
 // Implementation of AsyncDBM#initialize.
 static VALUE asyncdbm_initialize(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#initialize");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   volatile VALUE vdbm, vnum_threads;
   rb_scan_args(argc, argv, "20", &vdbm, &vnum_threads);
   StructDBM* sdbm = nullptr;
-  Data_Get_Struct(vdbm, StructDBM, sdbm);
+  TypedData_Get_Struct(vdbm, StructDBM, &type_dbm, sdbm);
   if (sdbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
+  CheckNoAttachedIndex(sdbm);
+  if (sdbm->read_cache != nullptr) {
+    rb_raise(rb_eRuntimeError, "not supported with the read cache");
+  }
+  if (sdbm->bloom_filter != nullptr) {
+    rb_raise(rb_eRuntimeError, "not supported with the Bloom filter");
+  }
   const int32_t num_threads = GetInteger(vnum_threads);
   sasync->async = std::make_unique<tkrzw::AsyncDBM>(sdbm->dbm.get(), num_threads);
+  sasync->concurrent = sdbm->concurrent;
+  RB_OBJ_WRITE(vself, &sasync->venc, sdbm->venc);
+  RB_OBJ_WRITE(vself, &sasync->vdbm, vdbm);
   return Qnil;
 }
 
 // Implementation of AsyncDBM#destruct.
 static VALUE asyncdbm_destruct(VALUE vself) {
+  ProbeScope probe("AsyncDBM#destruct");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   sasync->async.reset(nullptr);
   return Qnil;
 }
 
 // Implementation of AsyncDBM#to_s.
 static VALUE asyncdbm_to_s(VALUE vself) {
+  ProbeScope probe("AsyncDBM#to_s");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2597,8 +5054,9 @@ static VALUE asyncdbm_to_s(VALUE vself) {
 
 // Implementation of AsyncDBM#inspect.
 static VALUE asyncdbm_inspect(VALUE vself) {
+  ProbeScope probe("AsyncDBM#inspect");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     return rb_str_new2("#<Tkrzw::AsyncDBM:(not opened database)>");
   }
@@ -2609,21 +5067,24 @@ static VALUE asyncdbm_inspect(VALUE vself) {
 
 // Implementation of AsyncDBM#get.
 static VALUE asyncdbm_get(VALUE vself, VALUE vkey) {
+  ProbeScope probe("AsyncDBM#get");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   tkrzw::StatusFuture future(sasync->async->Get(key));
   return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
 }
 
 // Implementation of AsyncDBM#get_multi.
 static VALUE asyncdbm_get_multi(VALUE vself, VALUE vkeys) {
+  ProbeScope probe("AsyncDBM#get_multi");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2644,8 +5105,9 @@ static VALUE asyncdbm_get_multi(VALUE vself, VALUE vkeys) {
 
 // Implementation of AsyncDBM#set.
 static VALUE asyncdbm_set(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#set");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2653,8 +5115,10 @@ static VALUE asyncdbm_set(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "21", &vkey, &vvalue, &voverwrite);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   const bool overwrite = argc > 2 ? RTEST(voverwrite) : true;
   tkrzw::StatusFuture future(sasync->async->Set(key, value, overwrite));
   return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
@@ -2662,8 +5126,9 @@ static VALUE asyncdbm_set(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#set_multi.
 static VALUE asyncdbm_set_multi(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#set_multi");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2687,21 +5152,24 @@ static VALUE asyncdbm_set_multi(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#remove.
 static VALUE asyncdbm_remove(VALUE vself, VALUE vkey) {
+  ProbeScope probe("AsyncDBM#remove");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   tkrzw::StatusFuture future(sasync->async->Remove(key));
   return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
 }
 
 // Implementation of AsyncDBM#remove_multi.
 static VALUE asyncdbm_remove_multi(VALUE vself, VALUE vkeys) {
+  ProbeScope probe("AsyncDBM#remove_multi");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2722,8 +5190,9 @@ static VALUE asyncdbm_remove_multi(VALUE vself, VALUE vkeys) {
 
 // Implementation of AsyncDBM#append.
 static VALUE asyncdbm_append(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#append");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2731,8 +5200,10 @@ static VALUE asyncdbm_append(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "21", &vkey, &vvalue, &vdelim);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   vdelim = StringValueEx(vdelim);
   const std::string_view delim = GetStringView(vdelim);
   tkrzw::StatusFuture future(sasync->async->Append(key, value, delim));
@@ -2741,8 +5212,9 @@ static VALUE asyncdbm_append(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#append_multi.
 static VALUE asyncdbm_append_multi(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#append_multi");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2766,13 +5238,15 @@ static VALUE asyncdbm_append_multi(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#compare_exchange.
 static VALUE asyncdbm_compare_exchange(VALUE vself, VALUE vkey, VALUE vexpected, VALUE vdesired) {
+  ProbeScope probe("AsyncDBM#compare_exchange");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   std::string_view expected;
   if (vexpected != Qnil) {
     if (vexpected == obj_dbm_any_data) {
@@ -2797,8 +5271,9 @@ static VALUE asyncdbm_compare_exchange(VALUE vself, VALUE vkey, VALUE vexpected,
 
 // Implementation of AsyncDBM#increment.
 static VALUE asyncdbm_increment(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#increment");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2806,6 +5281,7 @@ static VALUE asyncdbm_increment(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "13", &vkey, &vinc, &vinit, &vstatus);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const int64_t inc = vinc == Qnil ? 1 : GetInteger(vinc);
   const int64_t init = vinit == Qnil ? 0 : GetInteger(vinit);
   tkrzw::StatusFuture future(sasync->async->Increment(key, inc, init));
@@ -2814,8 +5290,9 @@ static VALUE asyncdbm_increment(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#compare_exchange_multi.
 static VALUE asyncdbm_compare_exchange_multi(VALUE vself, VALUE vexpected, VALUE vdesired) {
+  ProbeScope probe("AsyncDBM#compare_exchange_multi");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2830,8 +5307,9 @@ static VALUE asyncdbm_compare_exchange_multi(VALUE vself, VALUE vexpected, VALUE
 
 // Implementation of AsyncDBM#rekey.
 static VALUE asyncdbm_rekey(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#rekey");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2839,6 +5317,7 @@ static VALUE asyncdbm_rekey(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "22", &vold_key, &vnew_key, &voverwrite, &vcopying);
   vold_key = StringValueEx(vold_key);
   const std::string_view old_key = GetStringView(vold_key);
+  probe.SetKeySize(old_key.size());
   vnew_key = StringValueEx(vnew_key);
   const std::string_view new_key = GetStringView(vnew_key);
   const bool overwrite = argc > 2 ? RTEST(voverwrite) : true;
@@ -2849,8 +5328,9 @@ static VALUE asyncdbm_rekey(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#pop_first.
 static VALUE asyncdbm_pop_first(VALUE vself) {
+  ProbeScope probe("AsyncDBM#pop_first");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2860,8 +5340,9 @@ static VALUE asyncdbm_pop_first(VALUE vself) {
 
 // Implementation of AsyncDBM#push_last.
 static VALUE asyncdbm_push_last(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#push_last");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2869,6 +5350,7 @@ static VALUE asyncdbm_push_last(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vvalue, &vwtime);
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   const double wtime = vwtime == Qnil ? -1.0 : GetFloat(vwtime);
   tkrzw::StatusFuture future(sasync->async->PushLast(value, wtime));
   return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
@@ -2876,8 +5358,9 @@ static VALUE asyncdbm_push_last(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#clear.
 static VALUE asyncdbm_clear(VALUE vself) {
+  ProbeScope probe("AsyncDBM#clear");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2887,8 +5370,9 @@ static VALUE asyncdbm_clear(VALUE vself) {
 
 // Implementation of AsyncDBM#rebuild.
 static VALUE asyncdbm_rebuild(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#rebuild");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2901,8 +5385,9 @@ static VALUE asyncdbm_rebuild(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#synchronize.
 static VALUE asyncdbm_synchronize(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#synchronize");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2916,8 +5401,9 @@ static VALUE asyncdbm_synchronize(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#copy_file_data.
 static VALUE asyncdbm_copy_file_data(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#copy_file_data");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2932,8 +5418,9 @@ static VALUE asyncdbm_copy_file_data(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of AsyncDBM#export.
 static VALUE asyncdbm_export(VALUE vself, VALUE vdestdbm) {
+  ProbeScope probe("AsyncDBM#export");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -2941,7 +5428,7 @@ static VALUE asyncdbm_export(VALUE vself, VALUE vdestdbm) {
     return MakeStatusValue(tkrzw::Status(tkrzw::Status::INVALID_ARGUMENT_ERROR));
   }
   StructDBM* sdest_dbm = nullptr;
-  Data_Get_Struct(vdestdbm, StructDBM, sdest_dbm);
+  TypedData_Get_Struct(vdestdbm, StructDBM, &type_dbm, sdest_dbm);
   if (sdest_dbm->dbm == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened database");
   }
@@ -2951,13 +5438,14 @@ static VALUE asyncdbm_export(VALUE vself, VALUE vdestdbm) {
 
 // Implementation of AsyncDBM#export_to_flat_records.
 static VALUE asyncdbm_export_to_flat_records(VALUE vself, VALUE vdest_file) {
+  ProbeScope probe("AsyncDBM#export_to_flat_records");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
   StructFile* sdest_file = nullptr;
-  Data_Get_Struct(vdest_file, StructFile, sdest_file);
+  TypedData_Get_Struct(vdest_file, StructFile, &type_file, sdest_file);
   if (sdest_file->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -2967,13 +5455,14 @@ static VALUE asyncdbm_export_to_flat_records(VALUE vself, VALUE vdest_file) {
 
 // Implementation of AsyncDBM#import_from_flat_records.
 static VALUE asyncdbm_import_from_flat_records(VALUE vself, VALUE vsrc_file) {
+  ProbeScope probe("AsyncDBM#import_from_flat_records");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
   StructFile* ssrc_file = nullptr;
-  Data_Get_Struct(vsrc_file, StructFile, ssrc_file);
+  TypedData_Get_Struct(vsrc_file, StructFile, &type_file, ssrc_file);
   if (ssrc_file->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -2983,8 +5472,9 @@ static VALUE asyncdbm_import_from_flat_records(VALUE vself, VALUE vsrc_file) {
 
 // Implementation of AsyncDBM#search.
 static VALUE asyncdbm_search(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncDBM#search");
   StructAsyncDBM* sasync = nullptr;
-  Data_Get_Struct(vself, StructAsyncDBM, sasync);
+  TypedData_Get_Struct(vself, StructAsyncDBM, &type_asyncdbm, sasync);
   if (sasync->async == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed object");
   }
@@ -3034,36 +5524,56 @@ static void DefineAsyncDBM() {
   rb_define_method(cls_asyncdbm, "inspect", (METHOD)asyncdbm_inspect, 0);
 }
 
+// Implementation of File#mark.
+static void file_mark(void* ptr) {
+  StructFile* sfile = (StructFile*)ptr;
+  rb_gc_mark_movable(sfile->venc);
+}
+
+// Implementation of File#compact.
+static void file_compact(void* ptr) {
+  StructFile* sfile = (StructFile*)ptr;
+  sfile->venc = rb_gc_location(sfile->venc);
+}
+
 // Implementation of File#del.
 static void file_del(void* ptr) {
   StructFile* sfile = (StructFile*)ptr;
-  sfile->file.reset(nullptr);
+  sfile->file.reset();
   delete sfile;
 }
 
+// Implementation of File#memsize.
+static size_t file_memsize(const void* ptr) {
+  return sizeof(StructFile);
+}
+
 // Implementation of File.new.
 static VALUE file_new(VALUE cls) {
   StructFile* sfile = new StructFile;
-  return Data_Wrap_Struct(cls_file, 0, file_del, sfile);
+  return TypedData_Wrap_Struct(cls_file, &type_file, sfile);
 }
 
 // Implementation of File#initialize.
 static VALUE file_initialize(VALUE vself) {
+  ProbeScope probe("File#initialize");
   return Qnil;
 }
 
 // Implementation of File#destruct.
 static VALUE file_destruct(VALUE vself) {
+  ProbeScope probe("File#destruct");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
-  sfile->file.reset(nullptr);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  sfile->file.reset();
   return Qnil;
 }
 
 // Implementation of File#open.
 static VALUE file_open(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#open");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file != nullptr) {
     rb_raise(rb_eRuntimeError, "opened file");
   }
@@ -3099,33 +5609,43 @@ static VALUE file_open(int argc, VALUE* argv, VALUE vself) {
   }
   sfile->file.reset(new tkrzw::PolyFile);
   sfile->concurrent = concurrent;
-  sfile->venc = GetEncoding(encoding);
+  RB_OBJ_WRITE(vself, &sfile->venc, GetEncoding(encoding));
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = sfile->file->OpenAdvanced(std::string(path), writable, open_options, params);
-    });
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of File#close.
 static VALUE file_close(VALUE vself) {
+  ProbeScope probe("File#close");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
+  // Closing the file under the tasks of an attached AsyncFile would break them.
+  if (sfile->file.use_count() > 1) {
+    tkrzw::Status status(tkrzw::Status::PRECONDITION_ERROR, "used by an AsyncFile");
+    probe.SetStatus(status);
+    return MakeStatusValue(std::move(status));
+  }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(true, [&]() {
     status = sfile->file->Close();
-  });
-  sfile->file.reset(nullptr);
+  }, sfile->gvl_stats.get());
+  sfile->file.reset();
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of File#read.
 static VALUE file_read(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#read");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -3133,44 +5653,231 @@ static VALUE file_read(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "21", &voff, &vsize, &vstatus);
   const int64_t off = std::max<int64_t>(0, GetInteger(voff));
   const int64_t size =  std::max<int64_t>(0, GetInteger(vsize));
-  char* buf = new char[size];
+  // The data is read directly into the buffer of the string object.
+  volatile VALUE vdata = rb_str_new(nullptr, size);
+  char* buf = RSTRING_PTR(vdata);
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = sfile->file->Read(off, buf, size);
-    });
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
   if (status == tkrzw::Status::SUCCESS) {
-    volatile VALUE vdata = MakeString(std::string_view(buf, size), sfile->venc);
-    delete[] buf;
+    if (sfile->venc != Qnil) {
+      rb_funcall(vdata, id_str_force_encoding, 1, sfile->venc);
+    }
     return vdata;
   }
-  delete[] buf;
   return Qnil;
 }
 
+// Implementation of File#read_into.
+static VALUE file_read_into(VALUE vself, VALUE voff, VALUE vsize, VALUE vbuf) {
+  ProbeScope probe("File#read_into");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  const int64_t off = std::max<int64_t>(0, GetInteger(voff));
+  const int64_t size =  std::max<int64_t>(0, GetInteger(vsize));
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  if (RB_TYPE_P(vbuf, T_STRING)) {
+    rb_str_resize(vbuf, size);
+    // The resize keeps a buffer shared with other strings if the length doesn't change, so
+    // the string is made independent before being written.
+    rb_str_modify(vbuf);
+    // The lock prevents other threads from modifying the string while it is filled.
+    rb_str_locktmp(vbuf);
+    char* buf = RSTRING_PTR(vbuf);
+    NativeFunction(sfile->concurrent, [&]() {
+        status = sfile->file->Read(off, buf, size);
+      }, sfile->gvl_stats.get());
+    rb_str_unlocktmp(vbuf);
+    ENC_CODERANGE_CLEAR(vbuf);
+#if defined(HAVE_RB_IO_BUFFER_GET_BYTES_FOR_WRITING)
+  } else if (rb_obj_is_kind_of(vbuf, rb_cIOBuffer)) {
+    void* base = nullptr;
+    size_t capacity = 0;
+    rb_io_buffer_get_bytes_for_writing(vbuf, &base, &capacity);
+    if (static_cast<int64_t>(capacity) < size) {
+      status.Set(tkrzw::Status::INVALID_ARGUMENT_ERROR, "too small buffer");
+    } else {
+      // The lock prevents other threads from resizing or freeing the buffer while it is filled.
+      rb_io_buffer_lock(vbuf);
+      NativeFunction(sfile->concurrent, [&]() {
+          status = sfile->file->Read(off, base, size);
+        }, sfile->gvl_stats.get());
+      rb_io_buffer_unlock(vbuf);
+    }
+#endif
+  } else {
+    rb_raise(rb_eTypeError, "the buffer must be a String or an IO::Buffer");
+  }
+  probe.SetValueSize(size);
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of File#pread_buffer.
+static VALUE file_pread_buffer(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#pread_buffer");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  volatile VALUE voff, vsize, vstatus;
+  rb_scan_args(argc, argv, "21", &voff, &vsize, &vstatus);
+#if defined(HAVE_RB_IO_BUFFER_GET_BYTES_FOR_WRITING)
+  const int64_t off = std::max<int64_t>(0, GetInteger(voff));
+  const int64_t size =  std::max<int64_t>(0, GetInteger(vsize));
+  volatile VALUE vbuf = rb_io_buffer_new(nullptr, size, RB_IO_BUFFER_INTERNAL);
+  void* base = nullptr;
+  size_t capacity = 0;
+  rb_io_buffer_get_bytes_for_writing(vbuf, &base, &capacity);
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sfile->concurrent, [&]() {
+      status = sfile->file->Read(off, base, size);
+    }, sfile->gvl_stats.get());
+  probe.SetValueSize(size);
+  probe.SetStatus(status);
+  if (rb_obj_is_instance_of(vstatus, cls_status)) {
+    SetStatusValue(vstatus, status);
+  }
+  if (status == tkrzw::Status::SUCCESS) {
+    return vbuf;
+  }
+  rb_io_buffer_free(vbuf);
+  return Qnil;
+#else
+  rb_raise(rb_eNotImpError, "IO::Buffer is not supported");
+  return Qnil;
+#endif
+}
+
 // Implementation of File#write.
 static VALUE file_write(VALUE vself, VALUE voff, VALUE vdata) {
+  ProbeScope probe("File#write");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
   const int64_t off = std::max<int64_t>(0, GetInteger(voff));
   vdata = StringValueEx(vdata);
   const std::string_view data = GetStringView(vdata);
+  probe.SetValueSize(data.size());
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = sfile->file->Write(off, data.data(), data.size());
-    });
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of File#read_multi.
+static VALUE file_read_multi(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#read_multi");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  volatile VALUE vranges, vstatus;
+  rb_scan_args(argc, argv, "11", &vranges, &vstatus);
+  if (TYPE(vranges) != T_ARRAY) {
+    rb_raise(rb_eArgError, "the ranges must be an array");
+  }
+  const int32_t num_ranges = RARRAY_LEN(vranges);
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  ranges.reserve(num_ranges);
+  int64_t total_size = 0;
+  for (int32_t i = 0; i < num_ranges; i++) {
+    volatile VALUE vrange = rb_ary_entry(vranges, i);
+    if (TYPE(vrange) != T_ARRAY || RARRAY_LEN(vrange) < 2) {
+      rb_raise(rb_eArgError, "each range must be a pair of the offset and the size");
+    }
+    const int64_t off = std::max<int64_t>(0, GetInteger(rb_ary_entry(vrange, 0)));
+    const int64_t size = std::max<int64_t>(0, GetInteger(rb_ary_entry(vrange, 1)));
+    ranges.emplace_back(off, size);
+    total_size += size;
+  }
+  probe.SetValueSize(total_size);
+  std::vector<std::string> data(num_ranges);
+  std::vector<tkrzw::Status> statuses(num_ranges);
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sfile->concurrent, [&]() {
+      for (int32_t i = 0; i < num_ranges; i++) {
+        data[i].resize(ranges[i].second);
+        statuses[i] = sfile->file->Read(ranges[i].first, data[i].data(), ranges[i].second);
+        status |= statuses[i];
+      }
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
+  if (rb_obj_is_instance_of(vstatus, cls_status)) {
+    SetStatusValue(vstatus, status);
+  }
+  volatile VALUE vresult = rb_ary_new2(num_ranges);
+  for (int32_t i = 0; i < num_ranges; i++) {
+    if (statuses[i] == tkrzw::Status::SUCCESS) {
+      rb_ary_push(vresult, MakeString(data[i], sfile->venc));
+    } else {
+      rb_ary_push(vresult, Qnil);
+    }
+  }
+  return vresult;
+}
+
+// Implementation of File#write_multi.
+static VALUE file_write_multi(VALUE vself, VALUE vrecords) {
+  ProbeScope probe("File#write_multi");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  if (TYPE(vrecords) != T_ARRAY) {
+    rb_raise(rb_eArgError, "the records must be an array");
+  }
+  const int32_t num_records = RARRAY_LEN(vrecords);
+  // The converted strings are kept alive until the data is written.
+  volatile VALUE vholder = rb_ary_new2(num_records);
+  std::vector<std::pair<int64_t, std::string_view>> records;
+  records.reserve(num_records);
+  int64_t total_size = 0;
+  for (int32_t i = 0; i < num_records; i++) {
+    volatile VALUE vrecord = rb_ary_entry(vrecords, i);
+    if (TYPE(vrecord) != T_ARRAY || RARRAY_LEN(vrecord) < 2) {
+      rb_raise(rb_eArgError, "each record must be a pair of the offset and the data");
+    }
+    const int64_t off = std::max<int64_t>(0, GetInteger(rb_ary_entry(vrecord, 0)));
+    volatile VALUE vdata = StringValueEx(rb_ary_entry(vrecord, 1));
+    rb_ary_push(vholder, vdata);
+    records.emplace_back(off, GetStringView(vdata));
+    total_size += RSTRING_LEN(vdata);
+  }
+  probe.SetValueSize(total_size);
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sfile->concurrent, [&]() {
+      for (const auto& record : records) {
+        status = sfile->file->Write(record.first, record.second.data(), record.second.size());
+        if (status != tkrzw::Status::SUCCESS) {
+          break;
+        }
+      }
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of File#append.
 static VALUE file_append(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#append");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -3178,11 +5885,13 @@ static VALUE file_append(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vdata, &vstatus);
   vdata = StringValueEx(vdata);
   const std::string_view data = GetStringView(vdata);
+  probe.SetValueSize(data.size());
   int64_t new_off = 0;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = sfile->file->Append(data.data(), data.size(), &new_off);
-    });
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
   if (rb_obj_is_instance_of(vstatus, cls_status)) {
     SetStatusValue(vstatus, status);
   }
@@ -3194,8 +5903,9 @@ static VALUE file_append(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of File#truncate.
 static VALUE file_truncate(VALUE vself, VALUE vsize) {
+  ProbeScope probe("File#truncate");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -3203,14 +5913,16 @@ static VALUE file_truncate(VALUE vself, VALUE vsize) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(true, [&]() {
     status = sfile->file->Truncate(size);
-  });
+  }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of File#synchronize.
 static VALUE file_synchronize(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#synchronize");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -3222,21 +5934,23 @@ static VALUE file_synchronize(int argc, VALUE* argv, VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = sfile->file->Synchronize(hard, off, size);
-    });
+    }, sfile->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of File#get_size.
 static VALUE file_get_size(VALUE vself) {
+  ProbeScope probe("File#get_size");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
   int64_t size = 0;
   NativeFunction(sfile->concurrent, [&]() {
       size = sfile->file->GetSizeSimple();
-    });
+    }, sfile->gvl_stats.get());
   if (size >= 0) {
     return LL2NUM(size);
   }
@@ -3245,8 +5959,9 @@ static VALUE file_get_size(VALUE vself) {
 
 // Implementation of File#get_path.
 static VALUE file_get_path(VALUE vself) {
+  ProbeScope probe("File#get_path");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -3254,32 +5969,220 @@ static VALUE file_get_path(VALUE vself) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = sfile->file->GetPath(&path);
-    });
+    }, sfile->gvl_stats.get());
   if (status == tkrzw::Status::SUCCESS) {
     return rb_str_new(path.data(), path.size());
   }
   return Qnil;
 }
 
+// Calls a function for each line which starts in a range of a text file.
+static tkrzw::Status ScanLinesInRange(
+    tkrzw::File* file, int64_t begin, int64_t end, int64_t file_size,
+    const std::function<bool(std::string_view, int64_t)>& proc) {
+  constexpr int64_t READ_SIZE = 1 << 20;
+  // The line which contains the byte before the range belongs to the previous range.
+  bool skipping = begin > 0;
+  int64_t buf_offset = skipping ? begin - 1 : begin;
+  int64_t read_offset = buf_offset;
+  std::string buf;
+  while (buf_offset < end) {
+    const int64_t read_size = std::min(READ_SIZE, file_size - read_offset);
+    const bool eof = read_size <= 0;
+    if (!eof) {
+      const size_t old_size = buf.size();
+      buf.resize(old_size + read_size);
+      const tkrzw::Status status = file->Read(read_offset, buf.data() + old_size, read_size);
+      if (status != tkrzw::Status::SUCCESS) {
+        return status;
+      }
+      read_offset += read_size;
+    }
+    size_t pos = 0;
+    while (pos < buf.size()) {
+      size_t line_end = buf.find('\n', pos);
+      if (line_end == std::string::npos) {
+        if (!eof) {
+          break;
+        }
+        line_end = buf.size();
+      }
+      if (skipping) {
+        skipping = false;
+      } else {
+        if (buf_offset + static_cast<int64_t>(pos) >= end) {
+          return tkrzw::Status(tkrzw::Status::SUCCESS);
+        }
+        if (!proc(std::string_view(buf.data() + pos, line_end - pos), buf_offset + pos)) {
+          return tkrzw::Status(tkrzw::Status::SUCCESS);
+        }
+      }
+      pos = line_end + 1;
+    }
+    if (eof) {
+      break;
+    }
+    buf.erase(0, pos);
+    buf_offset += pos;
+  }
+  return tkrzw::Status(tkrzw::Status::SUCCESS);
+}
+
+// Searches a text file on native threads and yields batches of matching lines.  This returns
+// the tag of the exception of the block, which must be rethrown by the caller.
+static int SearchTextFileInParallel(
+    StructFile* sfile, std::string_view mode, std::string_view pattern, int64_t capacity,
+    const std::map<std::string, std::string>& params, tkrzw::Status* status) {
+  const int32_t num_cores = std::max<int32_t>(std::thread::hardware_concurrency(), 1);
+  const int32_t num_threads = std::max<int64_t>(tkrzw::StrToInt(
+      tkrzw::SearchMap(params, "threads", tkrzw::ToString(num_cores))), 1);
+  const size_t batch_size = std::max<int64_t>(
+      tkrzw::StrToInt(tkrzw::SearchMap(params, "batch_size", "1000")), 1);
+  const int64_t chunk_size = std::max<int64_t>(
+      tkrzw::StrToInt(tkrzw::SearchMap(params, "chunk_size", "16777216")), 1);
+  std::function<bool(std::string_view)> matcher;
+  std::unique_ptr<std::regex> regex;
+  const std::string pattern_str(pattern);
+  if (mode == "contain") {
+    matcher = [&](std::string_view line) {
+      return line.find(pattern_str) != std::string_view::npos;
+    };
+  } else if (mode == "begin") {
+    matcher = [&](std::string_view line) {
+      return tkrzw::StrBeginsWith(line, pattern_str);
+    };
+  } else if (mode == "end") {
+    matcher = [&](std::string_view line) {
+      return tkrzw::StrEndsWith(line, pattern_str);
+    };
+  } else if (mode == "regex") {
+    try {
+      regex = std::make_unique<std::regex>(pattern_str);
+    } catch (const std::regex_error& err) {
+      status->Set(tkrzw::Status::INVALID_ARGUMENT_ERROR, "invalid regex");
+      return 0;
+    }
+    matcher = [&](std::string_view line) {
+      try {
+        return std::regex_search(line.begin(), line.end(), *regex);
+      } catch (const std::regex_error& err) {
+        return false;
+      }
+    };
+  } else {
+    status->Set(tkrzw::Status::INVALID_ARGUMENT_ERROR, "unsupported mode");
+    return 0;
+  }
+  int64_t file_size = 0;
+  NativeFunction(sfile->concurrent, [&]() {
+      *status = sfile->file->GetSize(&file_size);
+    }, sfile->gvl_stats.get());
+  if (*status != tkrzw::Status::SUCCESS) {
+    return 0;
+  }
+  RecordBatchQueue queue(num_threads * 2, num_threads);
+  std::atomic_int64_t next_chunk(0);
+  std::atomic_int64_t num_matches(0);
+  std::mutex mutex;
+  auto search = [&]() {
+    tkrzw::Status search_status(tkrzw::Status::SUCCESS);
+    RecordBatchQueue::Batch batch;
+    bool canceled = false;
+    while (!canceled && search_status == tkrzw::Status::SUCCESS) {
+      const int64_t begin = next_chunk++ * chunk_size;
+      if (begin >= file_size || (capacity > 0 && num_matches.load() >= capacity)) {
+        break;
+      }
+      const int64_t end = std::min(begin + chunk_size, file_size);
+      search_status = ScanLinesInRange(
+          sfile->file.get(), begin, end, file_size,
+          [&](std::string_view line, int64_t offset) {
+            if (!matcher(line)) {
+              return true;
+            }
+            if (capacity > 0 && num_matches++ >= capacity) {
+              canceled = true;
+              return false;
+            }
+            // The offset is carried as a decimal string to share the queue of records.
+            batch.emplace_back(std::string(line), tkrzw::ToString(offset));
+            if (batch.size() >= batch_size) {
+              if (!queue.Push(std::move(batch))) {
+                canceled = true;
+                return false;
+              }
+              batch.clear();
+            }
+            return true;
+          });
+    }
+    if (!batch.empty() && !queue.IsCanceled()) {
+      queue.Push(std::move(batch));
+    }
+    queue.FinishProducer();
+    std::lock_guard<std::mutex> lock(mutex);
+    *status |= search_status;
+  };
+  std::vector<std::thread> threads;
+  tkrzw::Status start_status = StartNativeThreads(&threads, num_threads, search, &queue);
+  if (start_status != tkrzw::Status::SUCCESS) {
+    *status = std::move(start_status);
+    return 0;
+  }
+  int result = 0;
+  while (true) {
+    RecordBatchPopper popper;
+    popper.queue = &queue;
+    rb_thread_call_without_gvl(PopRecordBatch, &popper, CancelRecordBatchQueue, &queue);
+    if (!popper.popped) {
+      break;
+    }
+    volatile VALUE vbatch = rb_ary_new2(popper.batch.size());
+    for (const auto& record : popper.batch) {
+      rb_ary_push(vbatch, rb_ary_new3(2, MakeString(record.first, sfile->venc),
+                                      LL2NUM(tkrzw::StrToInt(record.second))));
+    }
+    rb_protect(YieldToBlock, vbatch, &result);
+    if (result != 0) {
+      queue.Cancel();
+      break;
+    }
+  }
+  rb_thread_call_without_gvl(JoinNativeThreads, &threads, CancelRecordBatchQueue, &queue);
+  return result;
+}
+
 // Implementation of File#search.
 static VALUE file_search(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#search");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
-  volatile VALUE vmode, vpattern, vcapacity;
-  rb_scan_args(argc, argv, "21", &vmode, &vpattern, &vcapacity);
+  volatile VALUE vmode, vpattern, vcapacity, vparams;
+  rb_scan_args(argc, argv, "21:", &vmode, &vpattern, &vcapacity, &vparams);
   vmode = StringValueEx(vmode);
   const std::string_view mode = GetStringView(vmode);
   vpattern = StringValueEx(vpattern);
   const std::string_view pattern = GetStringView(vpattern);
   const int64_t capacity = GetInteger(vcapacity);
+  if (rb_block_given_p()) {
+    tkrzw::Status status(tkrzw::Status::SUCCESS);
+    const int result = SearchTextFileInParallel(
+        sfile, mode, pattern, capacity, HashToMap(vparams), &status);
+    if (result != 0) {
+      rb_jump_tag(result);
+    }
+    rb_thread_check_ints();
+    probe.SetStatus(status);
+    return MakeStatusValue(std::move(status));
+  }
   std::vector<std::string> lines;
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sfile->concurrent, [&]() {
       status = tkrzw::SearchTextFileModal(sfile->file.get(), mode, pattern, &lines, capacity);
-    });
+    }, sfile->gvl_stats.get());
   if (status != tkrzw::Status::SUCCESS) {
     const std::string& message = tkrzw::ToString(status);
     rb_raise(cls_expt, "%s", message.c_str());
@@ -3291,10 +6194,102 @@ static VALUE file_search(int argc, VALUE* argv, VALUE vself) {
   return vlines;
 }
 
+// Implementation of File#each_line.
+static VALUE file_each_line(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("File#each_line");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  volatile VALUE vparams;
+  rb_scan_args(argc, argv, "01", &vparams);
+  if (!rb_block_given_p()) {
+    rb_raise(rb_eArgError, "block is not given");
+  }
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  int result = 0;
+  {
+    const std::map<std::string, std::string> params = HashToMap(vparams);
+    const size_t batch_size = std::max<int64_t>(
+        tkrzw::StrToInt(tkrzw::SearchMap(params, "batch_size", "1000")), 1);
+    const int64_t chunk_size = std::max<int64_t>(
+        tkrzw::StrToInt(tkrzw::SearchMap(params, "chunk_size", "1048576")), 1);
+    // The buffer holds the data from the beginning of the current line.
+    int64_t buf_offset = std::max<int64_t>(
+        tkrzw::StrToInt(tkrzw::SearchMap(params, "start_offset", "0")), 0);
+    int64_t read_offset = buf_offset;
+    std::string buf;
+    bool eof = false;
+    std::vector<std::string_view> lines;
+    while (!eof) {
+      lines.clear();
+      NativeFunction(sfile->concurrent, [&]() {
+          int64_t file_size = 0;
+          status = sfile->file->GetSize(&file_size);
+          if (status != tkrzw::Status::SUCCESS) {
+            return;
+          }
+          const int64_t read_size = std::min(chunk_size, file_size - read_offset);
+          if (read_size > 0) {
+            const size_t old_size = buf.size();
+            buf.resize(old_size + read_size);
+            status = sfile->file->Read(read_offset, buf.data() + old_size, read_size);
+            if (status != tkrzw::Status::SUCCESS) {
+              return;
+            }
+            read_offset += read_size;
+          } else {
+            eof = true;
+          }
+          const char* rp = buf.data();
+          const char* ep = rp + buf.size();
+          while (rp < ep) {
+            const char* pv = static_cast<const char*>(std::memchr(rp, '\n', ep - rp));
+            if (pv == nullptr) {
+              if (eof) {
+                lines.emplace_back(rp, ep - rp);
+              }
+              break;
+            }
+            lines.emplace_back(rp, pv - rp);
+            rp = pv + 1;
+          }
+        }, sfile->gvl_stats.get());
+      if (status != tkrzw::Status::SUCCESS) {
+        break;
+      }
+      size_t consumed = 0;
+      for (size_t begin = 0; begin < lines.size() && result == 0; begin += batch_size) {
+        const size_t end = std::min(begin + batch_size, lines.size());
+        volatile VALUE vbatch = rb_ary_new2(end - begin);
+        for (size_t i = begin; i < end; i++) {
+          rb_ary_push(vbatch, MakeString(lines[i], sfile->venc));
+        }
+        const std::string_view& last = lines[end - 1];
+        consumed = std::min<size_t>(last.data() + last.size() + 1 - buf.data(), buf.size());
+        volatile VALUE args = rb_ary_new3(2, vbatch, LL2NUM(buf_offset + consumed));
+        rb_protect(YieldToBlock, args, &result);
+      }
+      if (result != 0) {
+        break;
+      }
+      buf.erase(0, consumed);
+      buf_offset += consumed;
+    }
+  }
+  if (result != 0) {
+    rb_jump_tag(result);
+  }
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
 // Implementation of File#to_s.
 static VALUE file_to_s(VALUE vself) {
+  ProbeScope probe("File#to_s");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened file");
   }
@@ -3323,8 +6318,9 @@ static VALUE file_to_s(VALUE vself) {
 
 // Implementation of File#inspect.
 static VALUE file_inspect(VALUE vself) {
+  ProbeScope probe("File#inspect");
   StructFile* sfile = nullptr;
-  Data_Get_Struct(vself, StructFile, sfile);
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
   if (sfile->file == nullptr) {
     return rb_str_new2("#<Tkrzw::File:(not opened file)>");
   }
@@ -3351,6 +6347,31 @@ static VALUE file_inspect(VALUE vself) {
   return rb_str_new(expr.data(), expr.size());
 }
 
+// Implementation of File#stats.
+static VALUE file_stats(VALUE vself) {
+  ProbeScope probe("File#stats");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  volatile VALUE vstats = rb_hash_new();
+  rb_hash_aset(vstats, rb_str_new2("gvl"), MakeGVLStatsValue(*sfile->gvl_stats));
+  return vstats;
+}
+
+// Implementation of File#reset_stats.
+static VALUE file_reset_stats(VALUE vself) {
+  ProbeScope probe("File#reset_stats");
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vself, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  ResetGVLStats(sfile->gvl_stats.get());
+  return Qnil;
+}
+
 // Defines the File class.
 static void DefineFile() {
   cls_file = rb_define_class_under(mod_tkrzw, "File", rb_cObject);
@@ -3360,47 +6381,280 @@ static void DefineFile() {
   rb_define_method(cls_file, "open", (METHOD)file_open, -1);
   rb_define_method(cls_file, "close", (METHOD)file_close, 0);
   rb_define_method(cls_file, "read", (METHOD)file_read, -1);
+  rb_define_method(cls_file, "read_into", (METHOD)file_read_into, 3);
+  rb_define_method(cls_file, "pread_buffer", (METHOD)file_pread_buffer, -1);
   rb_define_method(cls_file, "write", (METHOD)file_write, 2);
+  rb_define_method(cls_file, "read_multi", (METHOD)file_read_multi, -1);
+  rb_define_method(cls_file, "write_multi", (METHOD)file_write_multi, 1);
   rb_define_method(cls_file, "append", (METHOD)file_append, -1);
   rb_define_method(cls_file, "truncate", (METHOD)file_truncate, 1);
   rb_define_method(cls_file, "synchronize", (METHOD)file_synchronize, -1);
   rb_define_method(cls_file, "get_size", (METHOD)file_get_size, 0);
   rb_define_method(cls_file, "get_path", (METHOD)file_get_path, 0);
   rb_define_method(cls_file, "search", (METHOD)file_search, -1);
+  rb_define_method(cls_file, "each_line", (METHOD)file_each_line, -1);
   rb_define_method(cls_file, "to_s", (METHOD)file_to_s, 0);
   rb_define_method(cls_file, "inspect", (METHOD)file_inspect, 0);
+  rb_define_method(cls_file, "stats", (METHOD)file_stats, 0);
+  rb_define_method(cls_file, "reset_stats", (METHOD)file_reset_stats, 0);
+}
+
+// Implementation of AsyncFile#mark.
+static void asyncfile_mark(void* ptr) {
+  StructAsyncFile* sasync = (StructAsyncFile*)ptr;
+  rb_gc_mark_movable(sasync->venc);
+  rb_gc_mark_movable(sasync->vfile);
+}
+
+// Implementation of AsyncFile#compact.
+static void asyncfile_compact(void* ptr) {
+  StructAsyncFile* sasync = (StructAsyncFile*)ptr;
+  sasync->venc = rb_gc_location(sasync->venc);
+  sasync->vfile = rb_gc_location(sasync->vfile);
+}
+
+// Implementation of AsyncFile#del.
+static void asyncfile_del(void* ptr) {
+  StructAsyncFile* sasync = (StructAsyncFile*)ptr;
+  if (sasync->queue != nullptr) {
+    // The finalizer must not block, so the remaining tasks are finished by another thread.
+    // The tasks hold the file by themselves.
+    std::shared_ptr<tkrzw::TaskQueue> queue(std::move(sasync->queue));
+    try {
+      std::thread([queue]() { queue->Stop(tkrzw::INT32MAX); }).detach();
+    } catch (const std::system_error& err) {
+      queue->Stop(tkrzw::INT32MAX);
+    }
+  }
+  delete sasync;
+}
+
+// Implementation of AsyncFile#memsize.
+static size_t asyncfile_memsize(const void* ptr) {
+  return sizeof(StructAsyncFile);
+}
+
+// Implementation of AsyncFile.new.
+static VALUE asyncfile_new(VALUE cls) {
+  StructAsyncFile* sasync = new StructAsyncFile;
+  return TypedData_Wrap_Struct(cls_asyncfile, &type_asyncfile, sasync);
+}
+
+// Implementation of AsyncFile#initialize.
+static VALUE asyncfile_initialize(VALUE vself, VALUE vfile, VALUE vnum_threads) {
+  ProbeScope probe("AsyncFile#initialize");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  StructFile* sfile = nullptr;
+  TypedData_Get_Struct(vfile, StructFile, &type_file, sfile);
+  if (sfile->file == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened file");
+  }
+  const int32_t num_threads = std::max<int32_t>(GetInteger(vnum_threads), 1);
+  sasync->queue = std::make_unique<tkrzw::TaskQueue>();
+  sasync->queue->Start(num_threads);
+  sasync->file = sfile->file;
+  sasync->concurrent = sfile->concurrent;
+  RB_OBJ_WRITE(vself, &sasync->venc, sfile->venc);
+  RB_OBJ_WRITE(vself, &sasync->vfile, vfile);
+  return Qnil;
+}
+
+// Implementation of AsyncFile#destruct.
+static VALUE asyncfile_destruct(VALUE vself) {
+  ProbeScope probe("AsyncFile#destruct");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue != nullptr) {
+    NativeFunction(true, [&]() {
+        sasync->queue->Stop(tkrzw::INT32MAX);
+      });
+    sasync->queue.reset(nullptr);
+  }
+  sasync->file.reset();
+  return Qnil;
+}
+
+// Implementation of AsyncFile#to_s.
+static VALUE asyncfile_to_s(VALUE vself) {
+  ProbeScope probe("AsyncFile#to_s");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue == nullptr) {
+    rb_raise(rb_eRuntimeError, "destructed object");
+  }
+  const std::string str = tkrzw::SPrintF("AsyncFile:%p", (void*)sasync->file.get());
+  return rb_str_new(str.data(), str.size());
+}
+
+// Implementation of AsyncFile#inspect.
+static VALUE asyncfile_inspect(VALUE vself) {
+  ProbeScope probe("AsyncFile#inspect");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue == nullptr) {
+    return rb_str_new2("#<Tkrzw::AsyncFile:(destructed object)>");
+  }
+  const std::string str = tkrzw::SPrintF("#<Tkrzw::AsyncFile:%p>", (void*)sasync->file.get());
+  return rb_str_new(str.data(), str.size());
+}
+
+// Implementation of AsyncFile#read.
+static VALUE asyncfile_read(VALUE vself, VALUE voff, VALUE vsize) {
+  ProbeScope probe("AsyncFile#read");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue == nullptr) {
+    rb_raise(rb_eRuntimeError, "destructed object");
+  }
+  const int64_t off = std::max<int64_t>(0, GetInteger(voff));
+  const int64_t size = std::max<int64_t>(0, GetInteger(vsize));
+  auto promise = std::make_shared<std::promise<std::pair<tkrzw::Status, std::string>>>();
+  tkrzw::StatusFuture future(promise->get_future());
+  std::shared_ptr<tkrzw::PolyFile> file = sasync->file;
+  sasync->queue->Add([=]() {
+      std::pair<tkrzw::Status, std::string> result;
+      result.second.resize(size);
+      result.first = file->Read(off, result.second.data(), size);
+      if (result.first != tkrzw::Status::SUCCESS) {
+        result.second.clear();
+      }
+      promise->set_value(std::move(result));
+    });
+  return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
+}
+
+// Implementation of AsyncFile#write.
+static VALUE asyncfile_write(VALUE vself, VALUE voff, VALUE vdata) {
+  ProbeScope probe("AsyncFile#write");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue == nullptr) {
+    rb_raise(rb_eRuntimeError, "destructed object");
+  }
+  const int64_t off = std::max<int64_t>(0, GetInteger(voff));
+  vdata = StringValueEx(vdata);
+  const std::string_view data_view = GetStringView(vdata);
+  probe.SetValueSize(data_view.size());
+  auto promise = std::make_shared<std::promise<tkrzw::Status>>();
+  tkrzw::StatusFuture future(promise->get_future());
+  std::shared_ptr<tkrzw::PolyFile> file = sasync->file;
+  sasync->queue->Add([=, data = std::string(data_view)]() {
+      promise->set_value(file->Write(off, data.data(), data.size()));
+    });
+  return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
+}
+
+// Implementation of AsyncFile#append.
+static VALUE asyncfile_append(VALUE vself, VALUE vdata) {
+  ProbeScope probe("AsyncFile#append");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue == nullptr) {
+    rb_raise(rb_eRuntimeError, "destructed object");
+  }
+  vdata = StringValueEx(vdata);
+  const std::string_view data_view = GetStringView(vdata);
+  probe.SetValueSize(data_view.size());
+  auto promise = std::make_shared<std::promise<std::pair<tkrzw::Status, int64_t>>>();
+  tkrzw::StatusFuture future(promise->get_future());
+  std::shared_ptr<tkrzw::PolyFile> file = sasync->file;
+  sasync->queue->Add([=, data = std::string(data_view)]() {
+      std::pair<tkrzw::Status, int64_t> result(tkrzw::Status::SUCCESS, 0);
+      result.first = file->Append(data.data(), data.size(), &result.second);
+      promise->set_value(std::move(result));
+    });
+  return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
+}
+
+// Implementation of AsyncFile#synchronize.
+static VALUE asyncfile_synchronize(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("AsyncFile#synchronize");
+  StructAsyncFile* sasync = nullptr;
+  TypedData_Get_Struct(vself, StructAsyncFile, &type_asyncfile, sasync);
+  if (sasync->queue == nullptr) {
+    rb_raise(rb_eRuntimeError, "destructed object");
+  }
+  volatile VALUE vhard, voff, vsize;
+  rb_scan_args(argc, argv, "12", &vhard, &voff, &vsize);
+  const bool hard = RTEST(vhard);
+  const int64_t off = voff == Qnil ? 0 : std::max<int64_t>(0, GetInteger(voff));
+  const int64_t size = vsize == Qnil ? 0 : std::max<int64_t>(0, GetInteger(vsize));
+  auto promise = std::make_shared<std::promise<tkrzw::Status>>();
+  tkrzw::StatusFuture future(promise->get_future());
+  std::shared_ptr<tkrzw::PolyFile> file = sasync->file;
+  sasync->queue->Add([=]() {
+      promise->set_value(file->Synchronize(hard, off, size));
+    });
+  return MakeFutureValue(std::move(future), sasync->concurrent, sasync->venc);
+}
+
+// Defines the AsyncFile class.
+static void DefineAsyncFile() {
+  cls_asyncfile = rb_define_class_under(mod_tkrzw, "AsyncFile", rb_cObject);
+  rb_define_alloc_func(cls_asyncfile, asyncfile_new);
+  rb_define_private_method(cls_asyncfile, "initialize", (METHOD)asyncfile_initialize, 2);
+  rb_define_method(cls_asyncfile, "destruct", (METHOD)asyncfile_destruct, 0);
+  rb_define_method(cls_asyncfile, "read", (METHOD)asyncfile_read, 2);
+  rb_define_method(cls_asyncfile, "write", (METHOD)asyncfile_write, 2);
+  rb_define_method(cls_asyncfile, "append", (METHOD)asyncfile_append, 1);
+  rb_define_method(cls_asyncfile, "synchronize", (METHOD)asyncfile_synchronize, -1);
+  rb_define_method(cls_asyncfile, "to_s", (METHOD)asyncfile_to_s, 0);
+  rb_define_method(cls_asyncfile, "inspect", (METHOD)asyncfile_inspect, 0);
+}
+
+// Implementation of Index#mark.
+static void index_mark(void* ptr) {
+  StructIndex* sindex = (StructIndex*)ptr;
+  rb_gc_mark_movable(sindex->venc);
+}
+
+// Implementation of Index#compact.
+static void index_compact(void* ptr) {
+  StructIndex* sindex = (StructIndex*)ptr;
+  sindex->venc = rb_gc_location(sindex->venc);
 }
 
 // Implementation of Index#del.
 static void index_del(void* ptr) {
   StructIndex* sindex = (StructIndex*)ptr;
   sindex->index.reset(nullptr);
+  AdjustMemoryUsage(&sindex->memory_size, 0);
   delete sindex;
 }
 
+// Implementation of Index#memsize.
+static size_t index_memsize(const void* ptr) {
+  const StructIndex* sindex = (const StructIndex*)ptr;
+  return sizeof(*sindex) + sindex->memory_size;
+}
+
 // Implementation of Index.new.
 static VALUE index_new(VALUE cls) {
   StructIndex* sindex = new StructIndex;
-  return Data_Wrap_Struct(cls_index, 0, index_del, sindex);
+  return TypedData_Wrap_Struct(cls_index, &type_index, sindex);
 }
 
 // Implementation of Index#initialize.
 static VALUE index_initialize(VALUE vself) {
+  ProbeScope probe("Index#initialize");
   return Qnil;
 }
 
 // Implementation of Index#destruct.
 static VALUE index_destruct(VALUE vself) {
+  ProbeScope probe("Index#destruct");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   sindex->index.reset(nullptr);
   return Qnil;
 }
 
 // Implementation of DBM#open.
 static VALUE index_open(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#open");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index != nullptr) {
     rb_raise(rb_eRuntimeError, "opened index");
   }
@@ -3443,33 +6697,43 @@ static VALUE index_open(int argc, VALUE* argv, VALUE vself) {
   params.erase("encoding");
   sindex->index.reset(new tkrzw::PolyIndex());
   sindex->concurrent = concurrent;
-  sindex->venc = GetEncoding(encoding);
+  RB_OBJ_WRITE(vself, &sindex->venc, GetEncoding(encoding));
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Open(std::string(path), writable, open_options, params);
-    });
+    }, sindex->gvl_stats.get());
+  if (status == tkrzw::Status::SUCCESS) {
+    sindex->on_memory = IsOnMemoryDBM(sindex->index->GetInternalDBM());
+    AdjustIndexMemoryUsage(sindex);
+  }
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of DBM#close.
 static VALUE index_close(VALUE vself) {
+  ProbeScope probe("Index#close");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Close();
-    });
+    }, sindex->gvl_stats.get());
   sindex->index.reset(nullptr);
+  sindex->on_memory = false;
+  AdjustIndexMemoryUsage(sindex);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Index#include?.
 static VALUE index_include(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#include?");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
@@ -3477,19 +6741,22 @@ static VALUE index_include(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vkey, &vvalue);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   bool ok = false;
   NativeFunction(sindex->concurrent, [&]() {
       ok = sindex->index->Check(key, value);
-    });
+    }, sindex->gvl_stats.get());
   return ok ? Qtrue : Qfalse;
 }
 
 // Implementation of Index#get_values.
 static VALUE index_get_values(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#get_values");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
@@ -3497,11 +6764,208 @@ static VALUE index_get_values(int argc, VALUE* argv, VALUE vself) {
   rb_scan_args(argc, argv, "11", &vkey, &vmax);
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const int64_t capacity = GetInteger(vmax);
   std::vector<std::string> values;
   NativeFunction(sindex->concurrent, [&]() {
       values = sindex->index->GetValues(key, capacity);
-    });
+    }, sindex->gvl_stats.get());
+  volatile VALUE vvalues = rb_ary_new2(values.size());
+  for (const auto& value : values) {
+    rb_ary_push(vvalues, MakeString(value, sindex->venc));
+  }
+  return vvalues;
+}
+
+// Extracts keys of index records from an array object.  The converted strings are added to
+// the holder array to keep them alive.
+static std::vector<std::string_view> ExtractIndexKeys(VALUE vkeys, VALUE vholder) {
+  if (TYPE(vkeys) != T_ARRAY) {
+    rb_raise(rb_eArgError, "the keys must be an array");
+  }
+  const int64_t num_keys = RARRAY_LEN(vkeys);
+  std::vector<std::string_view> keys;
+  keys.reserve(num_keys);
+  for (int64_t i = 0; i < num_keys; i++) {
+    volatile VALUE vkey = StringValueEx(rb_ary_entry(vkeys, i));
+    rb_ary_push(vholder, vkey);
+    keys.emplace_back(GetStringView(vkey));
+  }
+  return keys;
+}
+
+// Implementation of Index#get_values_multi.
+static VALUE index_get_values_multi(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#get_values_multi");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vkeys, vmax;
+  rb_scan_args(argc, argv, "11", &vkeys, &vmax);
+  volatile VALUE vholder = rb_ary_new();
+  std::vector<std::string_view> keys = ExtractIndexKeys(vkeys, vholder);
+  const int64_t capacity = GetInteger(vmax);
+  std::vector<std::pair<std::string_view, std::vector<std::string>>> results;
+  NativeFunction(sindex->concurrent, [&]() {
+      // Looking up in the order of the keys visits the pages of the internal database in order.
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+      results.reserve(keys.size());
+      for (const auto& key : keys) {
+        results.emplace_back(key, sindex->index->GetValues(key, capacity));
+      }
+    }, sindex->gvl_stats.get());
+  volatile VALUE vresult = rb_hash_new();
+  for (const auto& result : results) {
+    volatile VALUE vvalues = rb_ary_new2(result.second.size());
+    for (const auto& value : result.second) {
+      rb_ary_push(vvalues, MakeString(value, sindex->venc));
+    }
+    rb_hash_aset(vresult, MakeString(result.first, sindex->venc), vvalues);
+  }
+  return vresult;
+}
+
+// Cursor on the values of a key in an index.
+struct IndexValueCursor {
+  std::unique_ptr<tkrzw::PolyIndex::Iterator> iter;
+  std::string_view key;
+  std::string value;
+
+  // Reads the value at the current position, or returns false if the records of the key are over.
+  bool Read() {
+    std::string rec_key;
+    return iter->Get(&rec_key, &value) && rec_key == key;
+  }
+};
+
+// Gets the values which all of the keys have, by leapfrogging the cursors of the keys.  Each
+// cursor jumps to the latest candidate, so values which can't match are skipped in the index.
+static std::vector<std::string> IntersectIndexValues(
+    tkrzw::PolyIndex* index, const std::vector<std::string_view>& keys, int64_t max) {
+  std::vector<std::string> result;
+  const size_t num_keys = keys.size();
+  if (num_keys == 0) {
+    return result;
+  }
+  std::vector<IndexValueCursor> cursors(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    cursors[i].iter = index->MakeIterator();
+    cursors[i].key = keys[i];
+  }
+  cursors[0].iter->Jump(keys[0]);
+  if (!cursors[0].Read()) {
+    return result;
+  }
+  std::string target = cursors[0].value;
+  size_t num_matched = 1;
+  size_t i = 1 % num_keys;
+  while (true) {
+    IndexValueCursor& cursor = cursors[i];
+    if (num_matched == num_keys) {
+      result.emplace_back(target);
+      if (max > 0 && static_cast<int64_t>(result.size()) >= max) {
+        break;
+      }
+      cursor.iter->Next();
+      if (!cursor.Read()) {
+        break;
+      }
+      target = cursor.value;
+      num_matched = 1;
+    } else {
+      cursor.iter->Jump(cursor.key, target);
+      if (!cursor.Read()) {
+        break;
+      }
+      if (cursor.value == target) {
+        num_matched++;
+      } else {
+        target = cursor.value;
+        num_matched = 1;
+      }
+    }
+    i = (i + 1) % num_keys;
+  }
+  return result;
+}
+
+// Gets the values which any of the keys has, by merging the cursors of the keys.
+static std::vector<std::string> UnionIndexValues(
+    tkrzw::PolyIndex* index, const std::vector<std::string_view>& keys, int64_t max) {
+  std::vector<std::string> result;
+  std::vector<IndexValueCursor> cursors(keys.size());
+  typedef std::pair<std::string, size_t> HeapRecord;
+  std::priority_queue<HeapRecord, std::vector<HeapRecord>, std::greater<HeapRecord>> heap;
+  for (size_t i = 0; i < keys.size(); i++) {
+    cursors[i].iter = index->MakeIterator();
+    cursors[i].key = keys[i];
+    cursors[i].iter->Jump(keys[i]);
+    if (cursors[i].Read()) {
+      heap.emplace(cursors[i].value, i);
+    }
+  }
+  while (!heap.empty()) {
+    const HeapRecord top = heap.top();
+    heap.pop();
+    if (result.empty() || result.back() != top.first) {
+      result.emplace_back(top.first);
+      if (max > 0 && static_cast<int64_t>(result.size()) >= max) {
+        break;
+      }
+    }
+    IndexValueCursor& cursor = cursors[top.second];
+    cursor.iter->Next();
+    if (cursor.Read()) {
+      heap.emplace(cursor.value, top.second);
+    }
+  }
+  return result;
+}
+
+// Implementation of Index#intersect.
+static VALUE index_intersect(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#intersect");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vkeys, vmax;
+  rb_scan_args(argc, argv, "11", &vkeys, &vmax);
+  volatile VALUE vholder = rb_ary_new();
+  const std::vector<std::string_view> keys = ExtractIndexKeys(vkeys, vholder);
+  const int64_t capacity = GetInteger(vmax);
+  std::vector<std::string> values;
+  NativeFunction(sindex->concurrent, [&]() {
+      values = IntersectIndexValues(sindex->index.get(), keys, capacity);
+    }, sindex->gvl_stats.get());
+  volatile VALUE vvalues = rb_ary_new2(values.size());
+  for (const auto& value : values) {
+    rb_ary_push(vvalues, MakeString(value, sindex->venc));
+  }
+  return vvalues;
+}
+
+// Implementation of Index#union.
+static VALUE index_union(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#union");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vkeys, vmax;
+  rb_scan_args(argc, argv, "11", &vkeys, &vmax);
+  volatile VALUE vholder = rb_ary_new();
+  const std::vector<std::string_view> keys = ExtractIndexKeys(vkeys, vholder);
+  const int64_t capacity = GetInteger(vmax);
+  std::vector<std::string> values;
+  NativeFunction(sindex->concurrent, [&]() {
+      values = UnionIndexValues(sindex->index.get(), keys, capacity);
+    }, sindex->gvl_stats.get());
   volatile VALUE vvalues = rb_ary_new2(values.size());
   for (const auto& value : values) {
     rb_ary_push(vvalues, MakeString(value, sindex->venc));
@@ -3511,100 +6975,188 @@ static VALUE index_get_values(int argc, VALUE* argv, VALUE vself) {
 
 // Implementation of Index#add.
 static VALUE index_add(VALUE vself, VALUE vkey, VALUE vvalue) {
+  ProbeScope probe("Index#add");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Add(key, value);
-    });
+    }, sindex->gvl_stats.get());
+  CountIndexUpdates(sindex, 1);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Index#remove.
 static VALUE index_remove(VALUE vself, VALUE vkey, VALUE vvalue) {
+  ProbeScope probe("Index#remove");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   vkey = StringValueEx(vkey);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   vvalue = StringValueEx(vvalue);
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Remove(key, value);
-    });
+    }, sindex->gvl_stats.get());
+  CountIndexUpdates(sindex, 1);
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
+// Extracts pairs of keys and values of index records from an array object.  The converted
+// strings are added to the holder array to keep them alive.
+static std::vector<std::pair<std::string_view, std::string_view>> ExtractIndexRecords(
+    VALUE vrecords, VALUE vholder) {
+  if (TYPE(vrecords) != T_ARRAY) {
+    rb_raise(rb_eArgError, "the records must be an array");
+  }
+  const int64_t num_records = RARRAY_LEN(vrecords);
+  std::vector<std::pair<std::string_view, std::string_view>> records;
+  records.reserve(num_records);
+  for (int64_t i = 0; i < num_records; i++) {
+    volatile VALUE vrecord = rb_ary_entry(vrecords, i);
+    if (TYPE(vrecord) != T_ARRAY || RARRAY_LEN(vrecord) < 2) {
+      rb_raise(rb_eArgError, "each record must be a pair of the key and the value");
+    }
+    volatile VALUE vkey = StringValueEx(rb_ary_entry(vrecord, 0));
+    volatile VALUE vvalue = StringValueEx(rb_ary_entry(vrecord, 1));
+    rb_ary_push(vholder, vkey);
+    rb_ary_push(vholder, vvalue);
+    records.emplace_back(GetStringView(vkey), GetStringView(vvalue));
+  }
+  return records;
+}
+
+// Implementation of Index#add_multi.
+static VALUE index_add_multi(VALUE vself, VALUE vrecords) {
+  ProbeScope probe("Index#add_multi");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vholder = rb_ary_new();
+  auto records = ExtractIndexRecords(vrecords, vholder);
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sindex->concurrent, [&]() {
+      // Records in the order of the keys are stored in fewer pages of the internal database.
+      std::sort(records.begin(), records.end());
+      for (const auto& record : records) {
+        status |= sindex->index->Add(record.first, record.second);
+      }
+    }, sindex->gvl_stats.get());
+  CountIndexUpdates(sindex, records.size());
+  probe.SetStatus(status);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of Index#remove_multi.
+static VALUE index_remove_multi(VALUE vself, VALUE vrecords) {
+  ProbeScope probe("Index#remove_multi");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vholder = rb_ary_new();
+  auto records = ExtractIndexRecords(vrecords, vholder);
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  NativeFunction(sindex->concurrent, [&]() {
+      std::sort(records.begin(), records.end());
+      for (const auto& record : records) {
+        status |= sindex->index->Remove(record.first, record.second);
+      }
+    }, sindex->gvl_stats.get());
+  CountIndexUpdates(sindex, records.size());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Index#count.
 static VALUE index_count(VALUE vself) {
+  ProbeScope probe("Index#count");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   int64_t count = 0;
   NativeFunction(sindex->concurrent, [&]() {
       count = sindex->index->Count();
-    });
+    }, sindex->gvl_stats.get());
   return LL2NUM(count);
 }
 
 // Implementation of Index#file_path.
 static VALUE index_file_path(VALUE vself) {
+  ProbeScope probe("Index#file_path");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   std::string path;
   NativeFunction(sindex->concurrent, [&]() {
       path = sindex->index->GetFilePath();
-    });
+    }, sindex->gvl_stats.get());
   return rb_str_new(path.data(), path.size());
 }
 
 // Implementation of Index#clear.
 static VALUE index_clear(VALUE vself) {
+  ProbeScope probe("Index#clear");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Clear();
-    });
+    }, sindex->gvl_stats.get());
+  AdjustIndexMemoryUsage(sindex);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Index#rebuild.
 static VALUE index_rebuild(VALUE vself) {
+  ProbeScope probe("Index#rebuild");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Rebuild();
-    });
+    }, sindex->gvl_stats.get());
+  AdjustIndexMemoryUsage(sindex);
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Index#synchronize.
 static VALUE index_synchronize(VALUE vself, VALUE vhard) {
+  ProbeScope probe("Index#synchronize");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
@@ -3612,21 +7164,24 @@ static VALUE index_synchronize(VALUE vself, VALUE vhard) {
   tkrzw::Status status(tkrzw::Status::SUCCESS);
   NativeFunction(sindex->concurrent, [&]() {
       status = sindex->index->Synchronize(hard);
-    });
+    }, sindex->gvl_stats.get());
+  probe.SetStatus(status);
   return MakeStatusValue(std::move(status));
 }
 
 // Implementation of Index#open?.
 static VALUE index_is_open(VALUE vself) {
+  ProbeScope probe("Index#open?");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   return sindex->index == nullptr ? Qfalse : Qtrue;
 }
 
 // Implementation of Index#writable?.
 static VALUE index_is_writable(VALUE vself) {
+  ProbeScope probe("Index#writable?");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
@@ -3636,13 +7191,15 @@ static VALUE index_is_writable(VALUE vself) {
 
 // Implementation of Index#make_iterator.
 static VALUE index_make_iterator(VALUE vself) {
+  ProbeScope probe("Index#make_iterator");
   return rb_class_new_instance(1, &vself, cls_indexiter);
 }
 
 // Implementation of Index#to_s.
 static VALUE index_to_s(VALUE vself) {
+  ProbeScope probe("Index#to_s");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
@@ -3651,29 +7208,31 @@ static VALUE index_to_s(VALUE vself) {
   NativeFunction(sindex->concurrent, [&]() {
       path = sindex->index->GetFilePath();
       count = sindex->index->Count();
-    });
+    }, sindex->gvl_stats.get());
   const std::string expr = tkrzw::StrCat(tkrzw::StrEscapeC(path, true), ":", count);
   return rb_str_new(expr.data(), expr.size());
 }
 
 // Implementation of Index#to_i.
 static VALUE index_to_i(VALUE vself) {
+  ProbeScope probe("Index#to_i");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   int64_t count = -1;
   NativeFunction(sindex->concurrent, [&]() {
       count = sindex->index->Count();
-    });
+    }, sindex->gvl_stats.get());
   return LL2NUM(count);
 }
 
 // Implementation of Index#inspect.
 static VALUE index_inspect(VALUE vself) {
+  ProbeScope probe("Index#inspect");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     return rb_str_new2("#<Tkrzw::Index:(not opened database)>");
   }
@@ -3682,7 +7241,7 @@ static VALUE index_inspect(VALUE vself) {
   NativeFunction(sindex->concurrent, [&]() {
       path = sindex->index->GetFilePath();
       count = sindex->index->Count();
-    });
+    }, sindex->gvl_stats.get());
   const std::string expr = tkrzw::StrCat(
       "#<Tkrzw::Index:", tkrzw::StrEscapeC(path, true), ":", count, ">");
   return rb_str_new(expr.data(), expr.size());
@@ -3690,8 +7249,9 @@ static VALUE index_inspect(VALUE vself) {
 
 // Implementation of Index#each.
 static VALUE index_each(VALUE vself) {
+  ProbeScope probe("Index#each");
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vself, StructIndex, sindex);
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
@@ -3702,13 +7262,13 @@ static VALUE index_each(VALUE vself) {
   NativeFunction(sindex->concurrent, [&]() {
       iter = sindex->index->MakeIterator();
       iter->First();
-    });
+    }, sindex->gvl_stats.get());
   while (true) {
     std::string key, value;
     bool ok = false;
     NativeFunction(sindex->concurrent, [&]() {
         ok = iter->Get(&key, &value);
-      });
+      }, sindex->gvl_stats.get());
     if (!ok) {
       break;
     }
@@ -3722,7 +7282,98 @@ static VALUE index_each(VALUE vself) {
     }
     NativeFunction(sindex->concurrent, [&]() {
         iter->Next();
-      });
+      }, sindex->gvl_stats.get());
+  }
+  return Qnil;
+}
+
+// Implementation of Index#stats.
+static VALUE index_stats(VALUE vself) {
+  ProbeScope probe("Index#stats");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vstats = rb_hash_new();
+  rb_hash_aset(vstats, rb_str_new2("gvl"), MakeGVLStatsValue(*sindex->gvl_stats));
+  return vstats;
+}
+
+// Implementation of Index#reset_stats.
+static VALUE index_reset_stats(VALUE vself) {
+  ProbeScope probe("Index#reset_stats");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  ResetGVLStats(sindex->gvl_stats.get());
+  return Qnil;
+}
+
+// Implementation of Index#each_range.
+static VALUE index_each_range(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("Index#each_range");
+  StructIndex* sindex = nullptr;
+  TypedData_Get_Struct(vself, StructIndex, &type_index, sindex);
+  if (sindex->index == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened index");
+  }
+  volatile VALUE vkey, vfrom, vto, vbatch_size;
+  rb_scan_args(argc, argv, "13", &vkey, &vfrom, &vto, &vbatch_size);
+  if (!rb_block_given_p()) {
+    rb_raise(rb_eArgError, "block is not given");
+  }
+  vkey = StringValueEx(vkey);
+  const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
+  vfrom = StringValueEx(vfrom);
+  const std::string_view from_value = GetStringView(vfrom);
+  const bool has_to_value = vto != Qnil;
+  if (has_to_value) {
+    vto = StringValueEx(vto);
+  }
+  const std::string_view to_value = has_to_value ? GetStringView(vto) : std::string_view();
+  const int64_t batch_size = vbatch_size == Qnil ? 1000 : std::max<int64_t>(
+      GetInteger(vbatch_size), 1);
+  int result = 0;
+  {
+    std::unique_ptr<tkrzw::PolyIndex::Iterator> iter;
+    NativeFunction(sindex->concurrent, [&]() {
+        iter = sindex->index->MakeIterator();
+        iter->Jump(key, from_value);
+      }, sindex->gvl_stats.get());
+    bool end = false;
+    while (!end) {
+      std::vector<std::string> values;
+      NativeFunction(sindex->concurrent, [&]() {
+          std::string rec_key, rec_value;
+          while (static_cast<int64_t>(values.size()) < batch_size) {
+            if (!iter->Get(&rec_key, &rec_value) || rec_key != key ||
+                (has_to_value && rec_value >= to_value)) {
+              end = true;
+              break;
+            }
+            values.emplace_back(std::move(rec_value));
+            iter->Next();
+          }
+        }, sindex->gvl_stats.get());
+      if (values.empty()) {
+        break;
+      }
+      volatile VALUE vvalues = rb_ary_new2(values.size());
+      for (const auto& value : values) {
+        rb_ary_push(vvalues, MakeString(value, sindex->venc));
+      }
+      rb_protect(YieldToBlock, vvalues, &result);
+      if (result != 0) {
+        break;
+      }
+    }
+  }
+  if (result != 0) {
+    rb_jump_tag(result);
   }
   return Qnil;
 }
@@ -3737,8 +7388,13 @@ static void DefineIndex() {
   rb_define_method(cls_index, "close", (METHOD)index_close, 0);
   rb_define_method(cls_index, "include?", (METHOD)index_include, -1);
   rb_define_method(cls_index, "get_values", (METHOD)index_get_values, -1);
+  rb_define_method(cls_index, "get_values_multi", (METHOD)index_get_values_multi, -1);
+  rb_define_method(cls_index, "intersect", (METHOD)index_intersect, -1);
+  rb_define_method(cls_index, "union", (METHOD)index_union, -1);
   rb_define_method(cls_index, "add", (METHOD)index_add, 2);
   rb_define_method(cls_index, "remove", (METHOD)index_remove, 2);
+  rb_define_method(cls_index, "add_multi", (METHOD)index_add_multi, 1);
+  rb_define_method(cls_index, "remove_multi", (METHOD)index_remove_multi, 1);
   rb_define_method(cls_index, "count", (METHOD)index_count, 0);
   rb_define_method(cls_index, "file_path", (METHOD)index_file_path, 0);
   rb_define_method(cls_index, "clear", (METHOD)index_clear, 0);
@@ -3750,7 +7406,24 @@ static void DefineIndex() {
   rb_define_method(cls_index, "to_s", (METHOD)index_to_s, 0);
   rb_define_method(cls_index, "to_i", (METHOD)index_to_i, 0);
   rb_define_method(cls_index, "inspect", (METHOD)index_inspect, 0);
+  rb_define_method(cls_index, "stats", (METHOD)index_stats, 0);
+  rb_define_method(cls_index, "reset_stats", (METHOD)index_reset_stats, 0);
   rb_define_method(cls_index, "each", (METHOD)index_each, 0);
+  rb_define_method(cls_index, "each_range", (METHOD)index_each_range, -1);
+}
+
+// Implementation of IndexIterator#mark.
+static void indexiter_mark(void* ptr) {
+  StructIndexIter* siter = (StructIndexIter*)ptr;
+  rb_gc_mark_movable(siter->venc);
+  rb_gc_mark_movable(siter->vindex);
+}
+
+// Implementation of IndexIterator#compact.
+static void indexiter_compact(void* ptr) {
+  StructIndexIter* siter = (StructIndexIter*)ptr;
+  siter->venc = rb_gc_location(siter->venc);
+  siter->vindex = rb_gc_location(siter->vindex);
 }
 
 // Implementation of IndexIterator#del.
@@ -3760,68 +7433,80 @@ static void indexiter_del(void* ptr) {
   delete siter;
 }
 
+// Implementation of IndexIterator#memsize.
+static size_t indexiter_memsize(const void* ptr) {
+  return sizeof(StructIndexIter);
+}
+
 // Implementation of IndexIterator.new.
 static VALUE indexiter_new(VALUE cls) {
   StructIndexIter* siter = new StructIndexIter;
-  return Data_Wrap_Struct(cls_indexiter, 0, indexiter_del, siter);
+  return TypedData_Wrap_Struct(cls_indexiter, &type_indexiter, siter);
 }
 
 // Implementation of IndexIterator#initialize.
 static VALUE indexiter_initialize(VALUE vself, VALUE vindex) {
+  ProbeScope probe("IndexIterator#initialize");
   if (!rb_obj_is_instance_of(vindex, cls_index)) {
     rb_raise(rb_eArgError, "#<Tkrzw::StatusException>");
   }
   StructIndex* sindex = nullptr;
-  Data_Get_Struct(vindex, StructIndex, sindex);
+  TypedData_Get_Struct(vindex, StructIndex, &type_index, sindex);
   if (sindex->index == nullptr) {
     rb_raise(rb_eRuntimeError, "not opened index");
   }
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   siter->iter = sindex->index->MakeIterator();
   siter->concurrent = sindex->concurrent;
-  siter->venc = sindex->venc;
+  RB_OBJ_WRITE(vself, &siter->venc, sindex->venc);
+  RB_OBJ_WRITE(vself, &siter->vindex, vindex);
+  siter->gvl_stats = sindex->gvl_stats;
   return Qnil;
 }
 
 // Implementation of IndexIterator#destruct.
 static VALUE indexiter_destruct(VALUE vself) {
+  ProbeScope probe("IndexIterator#destruct");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   siter->iter.reset(nullptr);
   return Qnil;
 }
 
 // Implementation of IndexIterator#first.
 static VALUE indexiter_first(VALUE vself) {
+  ProbeScope probe("IndexIterator#first");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   NativeFunction(siter->concurrent, [&]() {
       siter->iter->First();
-    });
+    }, siter->gvl_stats.get());
   return Qnil;
 }
 
 // Implementation of IndexIterator#last.
 static VALUE indexiter_last(VALUE vself) {
+  ProbeScope probe("IndexIterator#last");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   NativeFunction(siter->concurrent, [&]() {
       siter->iter->Last();
-    });
+    }, siter->gvl_stats.get());
   return Qnil;
 }
 
 // Implementation of IndexIterator#jump.
 static VALUE indexiter_jump(int argc, VALUE* argv, VALUE vself) {
+  ProbeScope probe("IndexIterator#jump");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -3830,43 +7515,48 @@ static VALUE indexiter_jump(int argc, VALUE* argv, VALUE vself) {
   vkey = StringValueEx(vkey);
   vvalue = StringValueEx(vvalue);
   const std::string_view key = GetStringView(vkey);
+  probe.SetKeySize(key.size());
   const std::string_view value = GetStringView(vvalue);
+  probe.SetValueSize(value.size());
   NativeFunction(siter->concurrent, [&]() {
       siter->iter->Jump(key, value);
-    });
+    }, siter->gvl_stats.get());
   return Qnil;
 }
 
 // Implementation of IndexIterator#next.
 static VALUE indexiter_next(VALUE vself) {
+  ProbeScope probe("IndexIterator#next");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   NativeFunction(siter->concurrent, [&]() {
       siter->iter->Next();
-    });
+    }, siter->gvl_stats.get());
   return Qnil;
 }
 
 // Implementation of IndexIterator#previous.
 static VALUE indexiter_previous(VALUE vself) {
+  ProbeScope probe("IndexIterator#previous");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
   NativeFunction(siter->concurrent, [&]() {
       siter->iter->Previous();
-    });
+    }, siter->gvl_stats.get());
   return Qnil;
 }
 
 // Implementation of IndexIterator#get.
 static VALUE indexiter_get(VALUE vself) {
+  ProbeScope probe("IndexIterator#get");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -3874,7 +7564,7 @@ static VALUE indexiter_get(VALUE vself) {
   bool ok = false;
   NativeFunction(siter->concurrent, [&]() {
       ok = siter->iter->Get(&key, &value);
-    });
+    }, siter->gvl_stats.get());
   if (ok) {
     volatile VALUE vary = rb_ary_new2(2);
     rb_ary_push(vary, MakeString(key, siter->venc));
@@ -3884,10 +7574,36 @@ static VALUE indexiter_get(VALUE vself) {
   return Qnil;
 }
 
+// Implementation of IndexIterator#get_batch.
+static VALUE indexiter_get_batch(VALUE vself, VALUE vnum) {
+  ProbeScope probe("IndexIterator#get_batch");
+  StructIndexIter* siter = nullptr;
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
+  if (siter->iter == nullptr) {
+    rb_raise(rb_eRuntimeError, "destructed Iterator");
+  }
+  const int64_t num = std::max<int64_t>(GetInteger(vnum), 0);
+  std::vector<std::pair<std::string, std::string>> records;
+  NativeFunction(siter->concurrent, [&]() {
+      std::string key, value;
+      while (static_cast<int64_t>(records.size()) < num && siter->iter->Get(&key, &value)) {
+        records.emplace_back(std::move(key), std::move(value));
+        siter->iter->Next();
+      }
+    }, siter->gvl_stats.get());
+  volatile VALUE vrecords = rb_ary_new2(records.size());
+  for (const auto& record : records) {
+    rb_ary_push(vrecords, rb_ary_new3(2, MakeString(record.first, siter->venc),
+                                      MakeString(record.second, siter->venc)));
+  }
+  return vrecords;
+}
+
 // Implementation of IndexIterator#to_s.
 static VALUE indexiter_to_s(VALUE vself) {
+  ProbeScope probe("IndexIterator#to_s");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     rb_raise(rb_eRuntimeError, "destructed Iterator");
   }
@@ -3895,7 +7611,7 @@ static VALUE indexiter_to_s(VALUE vself) {
   bool ok = false;
   NativeFunction(siter->concurrent, [&]() {
       ok = siter->iter->Get(&key);
-    });
+    }, siter->gvl_stats.get());
   if (!ok) {
     key = "(unlocated)";
   }
@@ -3905,8 +7621,9 @@ static VALUE indexiter_to_s(VALUE vself) {
 
 // Implementation of IndexIterator#inspect.
 static VALUE indexiter_inspect(VALUE vself) {
+  ProbeScope probe("IndexIterator#inspect");
   StructIndexIter* siter = nullptr;
-  Data_Get_Struct(vself, StructIndexIter, siter);
+  TypedData_Get_Struct(vself, StructIndexIter, &type_indexiter, siter);
   if (siter->iter == nullptr) {
     return rb_str_new2("#<Tkrzw::IndexIterator:(destructed object)>");
   }
@@ -3914,7 +7631,7 @@ static VALUE indexiter_inspect(VALUE vself) {
   bool ok = false;
   NativeFunction(siter->concurrent, [&]() {
       ok = siter->iter->Get(&key);
-    });
+    }, siter->gvl_stats.get());
   if (!ok) {
     key = "(unlocated)";
   }
@@ -3935,10 +7652,258 @@ static void DefineIndexIterator() {
   rb_define_method(cls_indexiter, "next", (METHOD)indexiter_next, 0);
   rb_define_method(cls_indexiter, "previous", (METHOD)indexiter_previous, 0);
   rb_define_method(cls_indexiter, "get", (METHOD)indexiter_get, 0);
+  rb_define_method(cls_indexiter, "get_batch", (METHOD)indexiter_get_batch, 1);
   rb_define_method(cls_indexiter, "to_s", (METHOD)indexiter_to_s, 0);
   rb_define_method(cls_indexiter, "inspect", (METHOD)indexiter_inspect, 0);
 }
 
+// Implementation of Pool#del.
+static void pool_del(void* ptr) {
+  delete (StructPool*)ptr;
+}
+
+// Implementation of Pool#memsize.
+static size_t pool_memsize(const void* ptr) {
+  const StructPool* spool = (const StructPool*)ptr;
+  return sizeof(*spool) +
+      spool->num_readers * (sizeof(std::atomic_int32_t) + sizeof(std::atomic_bool));
+}
+
+// Implementation of Pool.new.
+static VALUE pool_new(VALUE cls) {
+  StructPool* spool = new StructPool;
+  return TypedData_Wrap_Struct(cls_pool, &type_pool, spool);
+}
+
+// Implementation of Pool#initialize.
+static VALUE pool_initialize(VALUE vself) {
+  rb_ivar_set(vself, id_pool_readers, Qnil);
+  return Qnil;
+}
+
+// Closes the DBM objects of the pool.
+static tkrzw::Status ClosePoolDBMs(VALUE vself) {
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  std::vector<VALUE> vdbms;
+  volatile VALUE vreaders = rb_ivar_get(vself, id_pool_readers);
+  if (vreaders != Qnil) {
+    for (int32_t i = 0; i < RARRAY_LEN(vreaders); i++) {
+      vdbms.emplace_back(rb_ary_entry(vreaders, i));
+    }
+  }
+  for (auto vdbm : vdbms) {
+    StructDBM* sdbm = nullptr;
+    TypedData_Get_Struct(vdbm, StructDBM, &type_dbm, sdbm);
+    if (sdbm->dbm != nullptr) {
+      status |= GetStatusValue(dbm_close(vdbm));
+    }
+    sdbm->pool_slot = -1;
+  }
+  rb_ivar_set(vself, id_pool_readers, Qnil);
+  return status;
+}
+
+// Implementation of Pool#open.
+static VALUE pool_open(int argc, VALUE* argv, VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  if (spool->free_slots != nullptr) {
+    rb_raise(rb_eRuntimeError, "opened pool");
+  }
+  volatile VALUE vpath, vwritable, vparams;
+  rb_scan_args(argc, argv, "21", &vpath, &vwritable, &vparams);
+  vpath = StringValueEx(vpath);
+  if (RTEST(vwritable)) {
+    return MakeStatusValue(tkrzw::Status(
+        tkrzw::Status::INVALID_ARGUMENT_ERROR, "the pool is read-only"));
+  }
+  const std::map<std::string, std::string> params = HashToMap(vparams);
+  const int32_t num_readers = std::max<int32_t>(
+      tkrzw::StrToInt(tkrzw::SearchMap(params, "num_readers", "1")), 1);
+  volatile VALUE vdbm_params = TYPE(vparams) == T_HASH ? rb_hash_dup(vparams) : rb_hash_new();
+  rb_hash_delete(vdbm_params, ID2SYM(rb_intern("num_readers")));
+  rb_hash_delete(vdbm_params, rb_str_new2("num_readers"));
+  tkrzw::Status status(tkrzw::Status::SUCCESS);
+  rb_hash_delete(vdbm_params, ID2SYM(rb_intern("truncate")));
+  rb_hash_delete(vdbm_params, rb_str_new2("truncate"));
+  volatile VALUE vreaders = rb_ary_new2(num_readers);
+  rb_ivar_set(vself, id_pool_readers, vreaders);
+  for (int32_t i = 0; i < num_readers; i++) {
+    volatile VALUE vreader = rb_class_new_instance(0, nullptr, cls_dbm);
+    VALUE open_argv[3] = {vpath, Qfalse, vdbm_params};
+    status = GetStatusValue(dbm_open(3, open_argv, vreader));
+    if (status != tkrzw::Status::SUCCESS) {
+      ClosePoolDBMs(vself);
+      return MakeStatusValue(std::move(status));
+    }
+    StructDBM* sdbm = nullptr;
+    TypedData_Get_Struct(vreader, StructDBM, &type_dbm, sdbm);
+    sdbm->pool_slot = i;
+    rb_ary_push(vreaders, vreader);
+  }
+  spool->free_slots = std::make_unique<SlotStack>(num_readers);
+  spool->num_readers = num_readers;
+  spool->num_available.store(num_readers);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of Pool#close.
+static VALUE pool_close(VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  if (spool->free_slots == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened pool");
+  }
+  if (spool->num_available.load() != spool->num_readers) {
+    return MakeStatusValue(tkrzw::Status(
+        tkrzw::Status::PRECONDITION_ERROR, "readers are checked out"));
+  }
+  tkrzw::Status status = ClosePoolDBMs(vself);
+  spool->free_slots.reset(nullptr);
+  spool->num_readers = 0;
+  spool->num_available.store(0);
+  return MakeStatusValue(std::move(status));
+}
+
+// Implementation of Pool#checkout.
+static VALUE pool_checkout(VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  if (spool->free_slots == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened pool");
+  }
+  const int32_t slot = spool->free_slots->Pop();
+  if (slot < 0) {
+    return Qnil;
+  }
+  spool->num_available--;
+  return rb_ary_entry(rb_ivar_get(vself, id_pool_readers), slot);
+}
+
+// Implementation of Pool#checkin.
+static VALUE pool_checkin(VALUE vself, VALUE vdbm) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  if (spool->free_slots == nullptr) {
+    rb_raise(rb_eRuntimeError, "not opened pool");
+  }
+  if (!rb_obj_is_instance_of(vdbm, cls_dbm)) {
+    rb_raise(rb_eRuntimeError, "not a DBM object");
+  }
+  StructDBM* sdbm = nullptr;
+  TypedData_Get_Struct(vdbm, StructDBM, &type_dbm, sdbm);
+  const int32_t slot = sdbm->pool_slot;
+  if (slot < 0 || slot >= spool->num_readers ||
+      rb_ary_entry(rb_ivar_get(vself, id_pool_readers), slot) != vdbm) {
+    rb_raise(rb_eRuntimeError, "not a reader of the pool");
+  }
+  if (!spool->free_slots->Push(slot)) {
+    rb_raise(rb_eRuntimeError, "not checked out");
+  }
+  spool->num_available++;
+  {
+    // Taking the mutex orders the increment before the predicate check of waiters.
+    std::lock_guard<std::mutex> lock(spool->mutex);
+  }
+  spool->cond.notify_one();
+  return Qnil;
+}
+
+// Waits for a reader to be checked in.  This is called without the GVL.
+static void* WaitForPoolReader(void* param) {
+  PoolWaiter* waiter = (PoolWaiter*)param;
+  std::unique_lock<std::mutex> lock(waiter->spool->mutex);
+  waiter->spool->cond.wait(lock, [&]() {
+      return waiter->interrupted || waiter->spool->num_available.load() > 0;
+    });
+  return nullptr;
+}
+
+// Interrupts the waiter for a reader.
+static void InterruptPoolWaiter(void* param) {
+  PoolWaiter* waiter = (PoolWaiter*)param;
+  std::lock_guard<std::mutex> lock(waiter->spool->mutex);
+  waiter->interrupted = true;
+  waiter->spool->cond.notify_all();
+}
+
+// Checks in the reader after the block of Pool#with_reader.
+static VALUE pool_checkin_reader(VALUE vargs) {
+  return pool_checkin(rb_ary_entry(vargs, 0), rb_ary_entry(vargs, 1));
+}
+
+// Implementation of Pool#with_reader.
+static VALUE pool_with_reader(VALUE vself) {
+  rb_need_block();
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  volatile VALUE vreader = pool_checkout(vself);
+  while (vreader == Qnil) {
+    PoolWaiter waiter;
+    waiter.spool = spool;
+    rb_thread_call_without_gvl(WaitForPoolReader, &waiter, InterruptPoolWaiter, &waiter);
+    rb_thread_check_ints();
+    vreader = pool_checkout(vself);
+  }
+  volatile VALUE vargs = rb_ary_new3(2, vself, vreader);
+  return rb_ensure(YieldToBlock, vreader, pool_checkin_reader, vargs);
+}
+
+// Implementation of Pool#num_readers.
+static VALUE pool_num_readers(VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  return INT2FIX(spool->num_readers);
+}
+
+// Implementation of Pool#num_available.
+static VALUE pool_num_available(VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  return INT2FIX(spool->num_available.load());
+}
+
+// Implementation of Pool#to_s.
+static VALUE pool_to_s(VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  if (spool->free_slots == nullptr) {
+    return rb_str_new2("(not opened pool)");
+  }
+  const std::string expr = tkrzw::StrCat(
+      spool->num_available.load(), "/", spool->num_readers);
+  return rb_str_new(expr.data(), expr.size());
+}
+
+// Implementation of Pool#inspect.
+static VALUE pool_inspect(VALUE vself) {
+  StructPool* spool = nullptr;
+  TypedData_Get_Struct(vself, StructPool, &type_pool, spool);
+  if (spool->free_slots == nullptr) {
+    return rb_str_new2("#<Tkrzw::Pool:(not opened pool)>");
+  }
+  const std::string expr = tkrzw::StrCat(
+      "#<Tkrzw::Pool:", spool->num_available.load(), "/", spool->num_readers, ">");
+  return rb_str_new(expr.data(), expr.size());
+}
+
+// Defines the Pool class.
+static void DefinePool() {
+  cls_pool = rb_define_class_under(mod_tkrzw, "Pool", rb_cObject);
+  rb_define_alloc_func(cls_pool, pool_new);
+  rb_define_private_method(cls_pool, "initialize", (METHOD)pool_initialize, 0);
+  rb_define_method(cls_pool, "open", (METHOD)pool_open, -1);
+  rb_define_method(cls_pool, "close", (METHOD)pool_close, 0);
+  rb_define_method(cls_pool, "checkout", (METHOD)pool_checkout, 0);
+  rb_define_method(cls_pool, "checkin", (METHOD)pool_checkin, 1);
+  rb_define_method(cls_pool, "with_reader", (METHOD)pool_with_reader, 0);
+  rb_define_method(cls_pool, "num_readers", (METHOD)pool_num_readers, 0);
+  rb_define_method(cls_pool, "num_available", (METHOD)pool_num_available, 0);
+  rb_define_method(cls_pool, "to_s", (METHOD)pool_to_s, 0);
+  rb_define_method(cls_pool, "inspect", (METHOD)pool_inspect, 0);
+  id_pool_readers = rb_intern("@readers");
+}
+
 // Entry point of the library.
 void Init_tkrzw() {
   DefineModule();
@@ -3950,8 +7915,10 @@ void Init_tkrzw() {
   DefineIterator();
   DefineAsyncDBM();
   DefineFile();
+  DefineAsyncFile();
   DefineIndex();
   DefineIndexIterator();
+  DefinePool();
 }
 
 }  // extern "C"